@@ -0,0 +1,180 @@
+#include <rtlog/rtlog.h>
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace rtlog::bench {
+constexpr auto MAX_LOG_MESSAGE_LENGTH = 128;
+constexpr auto MAX_NUM_LOG_MESSAGES = 4096;
+constexpr auto NUM_MESSAGES = 1000000;
+
+struct LogData {
+  int level;
+};
+
+struct Result {
+  double p50Ns;
+  double p99Ns;
+  double p999Ns;
+  double maxNs;
+  double drainedPerSecond;
+  size_t numDropped;
+};
+
+static auto DiscardMessage = [](const LogData &, size_t, const char *, ...) {};
+
+// Each sequence number is declared right next to another hot global, the way
+// they typically end up in a real program. A third thread hammers the
+// neighbour for the whole run.
+std::atomic<std::size_t> gSequenceNumber{0};
+std::atomic<std::size_t> gNeighbour{0};
+
+PaddedSequenceNumber gPaddedSequenceNumber{0};
+std::atomic<std::size_t> gPaddedNeighbour{0};
+
+template <typename LoggerType>
+Result Run(LoggerType &logger, std::atomic<std::size_t> &neighbour) {
+  std::atomic<bool> producerDone{false};
+  std::atomic<bool> running{true};
+
+  size_t numDrained = 0;
+  std::chrono::nanoseconds drainTime{};
+  std::thread consumer{[&]() {
+    while (true) {
+      const bool lastPass = producerDone.load();
+      const auto start = std::chrono::steady_clock::now();
+      const auto numProcessed = logger.PrintAndClearLogQueue(DiscardMessage);
+      if (numProcessed > 0) {
+        drainTime += std::chrono::steady_clock::now() - start;
+        numDrained += static_cast<size_t>(numProcessed);
+      }
+      if (lastPass)
+        break;
+    }
+  }};
+
+  std::thread neighbourThread{[&]() {
+    while (running.load(std::memory_order_relaxed))
+      neighbour.fetch_add(1, std::memory_order_relaxed);
+  }};
+
+  std::vector<double> latencies(NUM_MESSAGES);
+  size_t numDropped = 0;
+  for (int i = 0; i < NUM_MESSAGES; i++) {
+    const auto start = std::chrono::steady_clock::now();
+#ifdef RTLOG_USE_STB
+    const auto status = logger.Log({i % 4}, "value %d gain %f", i, i * 0.5);
+#else
+    const auto status =
+        logger.Log({i % 4}, FMT_STRING("value {} gain {}"), i, i * 0.5);
+#endif // RTLOG_USE_STB
+    const auto end = std::chrono::steady_clock::now();
+
+    latencies[static_cast<size_t>(i)] = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count());
+    if (status == Status::Error_QueueFull)
+      numDropped++;
+  }
+
+  producerDone.store(true);
+  consumer.join();
+  running.store(false);
+  neighbourThread.join();
+
+  std::sort(latencies.begin(), latencies.end());
+  const auto percentile = [&](double p) {
+    return latencies[static_cast<size_t>(p * (latencies.size() - 1))];
+  };
+
+  const auto drainSeconds = std::chrono::duration<double>(drainTime).count();
+  return {percentile(0.5),
+          percentile(0.99),
+          percentile(0.999),
+          latencies.back(),
+          drainSeconds > 0 ? numDrained / drainSeconds : 0.0,
+          numDropped};
+}
+
+#ifdef RTLOG_USE_STB
+constexpr auto NUM_FORMAT_CALLS = 1000000;
+
+using FormatFn = int (*)(char *, size_t, const char *, va_list);
+
+static int StbFormat(char *buffer, size_t size, const char *format,
+                     va_list args) {
+  return stbsp_vsnprintf(buffer, static_cast<int>(size), format, args);
+}
+
+static int CallFormat(FormatFn formatFn, char *buffer, size_t size,
+                      const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  const auto result = formatFn(buffer, size, format, args);
+  va_end(args);
+  return result;
+}
+
+// Average ns per call of formatting a typical numeric message
+double TimeFormat(FormatFn formatFn) {
+  std::array<char, MAX_LOG_MESSAGE_LENGTH> buffer{};
+  size_t totalLength = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < NUM_FORMAT_CALLS; i++)
+    totalLength += static_cast<size_t>(
+        CallFormat(formatFn, buffer.data(), buffer.size(),
+                   "voice %d freq %.2f gain %f id %x", i % 64, 440.0 + i * 0.01,
+                   i * 0.001, static_cast<unsigned>(i)));
+  const auto end = std::chrono::steady_clock::now();
+
+  // Keep the calls from being optimized away
+  if (totalLength == 0)
+    printf("%s\n", buffer.data());
+
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         NUM_FORMAT_CALLS;
+}
+#endif // RTLOG_USE_STB
+
+void PrintResult(const char *name, const Result &result) {
+  printf("%-28s %8.0f %8.0f %8.0f %10.0f %14.0f %10zu\n", name, result.p50Ns,
+         result.p99Ns, result.p999Ns, result.maxNs, result.drainedPerSecond,
+         result.numDropped);
+}
+
+} // namespace rtlog::bench
+
+using namespace rtlog::bench;
+
+int main() {
+  printf("%d messages of up to %d chars, queue of %d\n\n", NUM_MESSAGES,
+         MAX_LOG_MESSAGE_LENGTH, MAX_NUM_LOG_MESSAGES);
+  printf("%-28s %8s %8s %8s %10s %14s %10s\n", "layout", "p50 ns", "p99 ns",
+         "p99.9 ns", "max ns", "drained msg/s", "dropped");
+
+  {
+    auto logger = std::make_unique<
+        rtlog::Logger<LogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
+                      gSequenceNumber>>();
+    PrintResult("default", Run(*logger, gNeighbour));
+  }
+
+  {
+    auto logger = std::make_unique<
+        rtlog::Logger<LogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
+                      gPaddedSequenceNumber, rtlog::rtlog_SPSC_CacheAligned>>();
+    PrintResult("cache aligned + padded seq", Run(*logger, gPaddedNeighbour));
+  }
+
+#ifdef RTLOG_USE_STB
+  printf("\n%-28s %8s\n", "formatting", "ns/call");
+  printf("%-28s %8.1f\n", "stb_sprintf", TimeFormat(StbFormat));
+  printf("%-28s %8.1f\n", "rtlog fast format",
+         TimeFormat(rtlog::detail::FastFormatMessage));
+#endif // RTLOG_USE_STB
+
+  return 0;
+}
@@ -45,23 +45,39 @@ struct LogData {
   LogRegion region;
 };
 
-class PrintMessageFunctor {
+class PrintToConsoleFunctor {
 public:
-  explicit PrintMessageFunctor(const std::string &filename) : mFile(filename) {
+  void operator()(const LogData &data, size_t sequenceNumber,
+                  const char *fstring, ...) {
+    std::array<char, MAX_LOG_MESSAGE_LENGTH> buffer;
+
+    va_list args;
+    va_start(args, fstring);
+    vsnprintf(buffer.data(), buffer.size(), fstring, args);
+    va_end(args);
+
+    printf("{%zu} [%s] (%s): %s\n", sequenceNumber, to_string(data.level),
+           to_string(data.region), buffer.data());
+  }
+};
+
+class PrintToFileFunctor {
+public:
+  explicit PrintToFileFunctor(const std::string &filename) : mFile(filename) {
     mFile.open(filename);
     mFile.clear();
   }
 
-  ~PrintMessageFunctor() {
+  ~PrintToFileFunctor() {
     if (mFile.is_open()) {
       mFile.close();
     }
   }
 
-  PrintMessageFunctor(const PrintMessageFunctor &) = delete;
-  PrintMessageFunctor(PrintMessageFunctor &&) = delete;
-  PrintMessageFunctor &operator=(const PrintMessageFunctor &) = delete;
-  PrintMessageFunctor &operator=(PrintMessageFunctor &&) = delete;
+  PrintToFileFunctor(const PrintToFileFunctor &) = delete;
+  PrintToFileFunctor(PrintToFileFunctor &&) = delete;
+  PrintToFileFunctor &operator=(const PrintToFileFunctor &) = delete;
+  PrintToFileFunctor &operator=(PrintToFileFunctor &&) = delete;
 
   void operator()(const LogData &data, size_t sequenceNumber,
                   const char *fstring, ...) {
@@ -72,16 +88,50 @@ public:
     vsnprintf(buffer.data(), buffer.size(), fstring, args);
     va_end(args);
 
-    printf("{%zu} [%s] (%s): %s\n", sequenceNumber, to_string(data.level),
-           to_string(data.region), buffer.data());
-
     mFile << "{" << sequenceNumber << "} [" << to_string(data.level) << "] ("
           << to_string(data.region) << "): " << buffer.data() << std::endl;
   }
   std::ofstream mFile;
 };
 
-static PrintMessageFunctor PrintMessage("everlog.txt");
+static PrintToConsoleFunctor PrintToConsole;
+static PrintToFileFunctor PrintToFile("everlog.txt");
+
+// Keep the busy engine region off the console, the file gets everything
+static auto IsNotEngineMessage = [](const LogData &data) {
+  return data.region != LogRegion::Engine;
+};
+
+static rtlog::SinkQueue<LogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
+                        decltype(IsNotEngineMessage)>
+    gConsoleQueue{IsNotEngineMessage};
+static rtlog::SinkQueue<LogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH>
+    gFileQueue;
+
+// Each sink is drained by its own thread, so a stalled file write never holds
+// up the console or the realtime queue
+static rtlog::FanOut PrintMessage(gConsoleQueue, gFileQueue);
+
+// Messages from the non realtime threads are buffered here, and forwarded to
+// the sinks by the same thread as the realtime ones
+static rtlog::SinkQueue<LogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH>
+    gNonRealtimeQueue;
+
+// Drains both the realtime logger and gNonRealtimeQueue, so a single thread
+// pushes into the console and file queues
+template <typename LoggerType> class DrainBoth {
+public:
+  explicit DrainBoth(LoggerType &logger) : mLogger(logger) {}
+
+  template <typename PrintLogFn>
+  int PrintAndClearLogQueue(PrintLogFn &&printLogFn) {
+    return mLogger.PrintAndClearLogQueue(printLogFn) +
+           gNonRealtimeQueue.PrintAndClearLogQueue(printLogFn);
+  }
+
+private:
+  LoggerType &mLogger;
+};
 
 template <typename LoggerType>
 void RealtimeBusyWait(int milliseconds, LoggerType &logger) {
@@ -109,17 +159,17 @@ static rtlog::Logger<LogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
     gRealtimeLogger;
 
 #define EVR_LOG_DEBUG(Region, fstring, ...)                                    \
-  PrintMessage({LogLevel::Debug, Region}, ++gSequenceNumber, fstring,          \
-               ##__VA_ARGS__)
+  gNonRealtimeQueue({LogLevel::Debug, Region}, ++gSequenceNumber, fstring,     \
+                    ##__VA_ARGS__)
 #define EVR_LOG_INFO(Region, fstring, ...)                                     \
-  PrintMessage({LogLevel::Info, Region}, ++gSequenceNumber, fstring,           \
-               ##__VA_ARGS__)
+  gNonRealtimeQueue({LogLevel::Info, Region}, ++gSequenceNumber, fstring,      \
+                    ##__VA_ARGS__)
 #define EVR_LOG_WARNING(Region, fstring, ...)                                  \
-  PrintMessage({LogLevel::Warning, Region}, ++gSequenceNumber, fstring,        \
-               ##__VA_ARGS__)
+  gNonRealtimeQueue({LogLevel::Warning, Region}, ++gSequenceNumber, fstring,   \
+                    ##__VA_ARGS__)
 #define EVR_LOG_CRITICAL(Region, ...)                                          \
-  PrintMessage({LogLevel::Critical, Region}, ++gSequenceNumber, fstring,       \
-               ##__VA_ARGS__)
+  gNonRealtimeQueue({LogLevel::Critical, Region}, ++gSequenceNumber, fstring,  \
+                    ##__VA_ARGS__)
 
 #ifdef RTLOG_USE_STB
 #define EVR_RTLOG_DEBUG(Region, fstring, ...)                                  \
@@ -165,7 +215,12 @@ static rtlog::Logger<LogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
 int main() {
   EVR_LOG_INFO(LogRegion::Network, "Hello from main thread!");
 
-  rtlog::LogProcessingThread thread(gRealtimeLogger, PrintMessage,
+  rtlog::LogProcessingThread consoleThread(gConsoleQueue, PrintToConsole,
+                                           std::chrono::milliseconds(10));
+  rtlog::LogProcessingThread fileThread(gFileQueue, PrintToFile,
+                                        std::chrono::milliseconds(10));
+  DrainBoth allMessages(gRealtimeLogger);
+  rtlog::LogProcessingThread thread(allMessages, PrintMessage,
                                     std::chrono::milliseconds(10));
 
   std::thread realtimeThread{[&]() {
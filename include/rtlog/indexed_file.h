@@ -0,0 +1,916 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#define RTLOG_UNDEF_NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#define RTLOG_UNDEF_WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#ifdef RTLOG_UNDEF_NOMINMAX
+#undef NOMINMAX
+#undef RTLOG_UNDEF_NOMINMAX
+#endif
+#ifdef RTLOG_UNDEF_WIN32_LEAN_AND_MEAN
+#undef WIN32_LEAN_AND_MEAN
+#undef RTLOG_UNDEF_WIN32_LEAN_AND_MEAN
+#endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+/*
+ * Indexed binary log files.
+ *
+ * IndexedFileSink is a PrintLogFn that writes records in blocks, and a sparse
+ * index of those blocks when it is closed. IndexedFileReader memory maps such
+ * a file and only decodes the blocks overlapping a sequence number or time
+ * range, so pulling a few seconds around an incident out of a multi GB log
+ * does not mean scanning all of it. See tools/rtlog_query for a command line
+ * front end.
+ *
+ * File layout, all integers in native byte order:
+ *
+ *     IndexedFileHeader
+ *     { IndexedBlockHeader, payload of mStoredSize bytes } per block
+ *     IndexedFileBlock per block  <- the index, written on Close
+ *     IndexedFileFooter
+ *
+ * A block payload is a sequence of records, each an IndexedRecordHeader, the
+ * raw bytes of the LogData and mMessageSize bytes of message (not null
+ * terminated). Blocks flagged IndexedBlockCompressed store the payload with
+ * sequence numbers and timestamps delta coded, then LZ compressed, each on
+ * its own so any block can be read without the others.
+ *
+ * A file that was never closed has no index; the reader then rebuilds it by
+ * hopping from block header to block header, which still never touches the
+ * records.
+ */
+
+namespace rtlog {
+
+enum class IndexedFileCompression {
+  None,
+  // Fast built in LZ compression of each block, on the thread running the sink
+  Lz
+};
+
+/**
+ * @brief One entry of the sparse index: where a block is and the range of
+ * sequence numbers and timestamps it holds.
+ */
+struct IndexedFileBlock {
+  uint64_t mOffset{};
+  uint64_t mMinSequenceNumber{};
+  uint64_t mMaxSequenceNumber{};
+  // Nanoseconds since the system_clock epoch
+  int64_t mMinTimestamp{};
+  int64_t mMaxTimestamp{};
+};
+
+namespace detail {
+
+inline constexpr std::array<char, 8> IndexedFileMagic{'R', 'T', 'L', 'O',
+                                                      'G', 'I', 'D', 'X'};
+inline constexpr std::array<char, 8> IndexedFileFooterMagic{
+    'R', 'T', 'L', 'O', 'G', 'E', 'N', 'D'};
+// Version 2 added compressed blocks. A version 1 file is laid out the same,
+// with none of them, so it is still read; newer versions are rejected.
+inline constexpr uint32_t IndexedFileVersion = 2;
+inline constexpr uint32_t IndexedFileOldestVersion = 1;
+inline constexpr uint32_t IndexedBlockMagic = 0x4b4c4252; // "RBLK"
+inline constexpr uint32_t IndexedBlockCompressed = 1u << 0;
+
+struct IndexedFileHeader {
+  std::array<char, 8> mMagic{IndexedFileMagic};
+  uint32_t mVersion{IndexedFileVersion};
+  uint32_t mLogDataSize{};
+};
+
+struct IndexedBlockHeader {
+  uint32_t mMagic{IndexedBlockMagic};
+  uint32_t mFlags{};
+  uint32_t mNumRecords{};
+  // Size of the records, and of what is actually stored in the file
+  uint32_t mPayloadSize{};
+  uint32_t mStoredSize{};
+  uint32_t mReserved{};
+  uint64_t mMinSequenceNumber{};
+  uint64_t mMaxSequenceNumber{};
+  int64_t mMinTimestamp{};
+  int64_t mMaxTimestamp{};
+};
+
+struct IndexedRecordHeader {
+  uint64_t mSequenceNumber{};
+  int64_t mTimestamp{};
+  uint32_t mMessageSize{};
+  uint32_t mReserved{};
+};
+
+struct IndexedFileFooter {
+  uint64_t mIndexOffset{};
+  uint64_t mNumBlocks{};
+  std::array<char, 8> mMagic{IndexedFileFooterMagic};
+};
+
+// Records are packed back to back, so they are read through memcpy
+template <typename T> bool ReadAt(const std::byte *data, size_t size,
+                                  size_t offset, T &value) {
+  if (offset > size || size - offset < sizeof(T))
+    return false;
+  std::memcpy(&value, data + offset, sizeof(T));
+  return true;
+}
+
+// LZ77 block compressor in the spirit of LZ4: a sequence is a token (literal
+// length << 4 | match length - 4), extra length bytes for either nibble at
+// 15, the literals, then a 2 byte little endian match offset. The last
+// sequence has literals only. Every block is compressed on its own, so each
+// one can be decompressed without the others.
+inline constexpr size_t LzMinMatch = 4;
+inline constexpr size_t LzMaxOffset = 65535;
+inline constexpr int LzHashBits = 12;
+
+inline void LzWriteLength(std::vector<char> &out, size_t length) {
+  for (; length >= 255; length -= 255)
+    out.push_back(static_cast<char>(255));
+  out.push_back(static_cast<char>(length));
+}
+
+inline void LzWriteSequence(std::vector<char> &out, const char *literals,
+                            size_t numLiterals, size_t offset,
+                            size_t matchLength) {
+  const auto extraMatch = matchLength - LzMinMatch;
+  out.push_back(static_cast<char>((std::min<size_t>(numLiterals, 15) << 4) |
+                                  std::min<size_t>(extraMatch, 15)));
+  if (numLiterals >= 15)
+    LzWriteLength(out, numLiterals - 15);
+  out.insert(out.end(), literals, literals + numLiterals);
+
+  out.push_back(static_cast<char>(offset & 0xff));
+  out.push_back(static_cast<char>(offset >> 8));
+  if (extraMatch >= 15)
+    LzWriteLength(out, extraMatch - 15);
+}
+
+// table holds the position + 1 of the last occurence of each hashed 4 byte
+// sequence. It is only scratch, pass the same one for every block so it is
+// allocated once.
+inline void LzCompress(const char *data, size_t size,
+                       std::vector<uint32_t> &table, std::vector<char> &out) {
+  out.clear();
+  table.assign(size_t{1} << LzHashBits, 0);
+
+  const auto read32 = [data](size_t position) {
+    uint32_t value;
+    std::memcpy(&value, data + position, sizeof(value));
+    return value;
+  };
+
+  size_t anchor = 0;
+  size_t position = 0;
+  while (position + LzMinMatch <= size) {
+    const auto sequence = read32(position);
+    const auto hash = (sequence * 2654435761u) >> (32 - LzHashBits);
+    const auto candidate = table[hash];
+    table[hash] = static_cast<uint32_t>(position + 1);
+
+    if (candidate == 0 || position - (candidate - 1) > LzMaxOffset ||
+        read32(candidate - 1) != sequence) {
+      position++;
+      continue;
+    }
+
+    const size_t match = candidate - 1;
+    auto matchLength = LzMinMatch;
+    while (position + matchLength < size &&
+           data[match + matchLength] == data[position + matchLength])
+      matchLength++;
+
+    LzWriteSequence(out, data + anchor, position - anchor, position - match,
+                    matchLength);
+    position += matchLength;
+    anchor = position;
+  }
+
+  const auto numLiterals = size - anchor;
+  out.push_back(static_cast<char>(std::min<size_t>(numLiterals, 15) << 4));
+  if (numLiterals >= 15)
+    LzWriteLength(out, numLiterals - 15);
+  out.insert(out.end(), data + anchor, data + size);
+}
+
+// Returns false unless data decompresses to exactly size bytes
+inline bool LzDecompress(const std::byte *data, size_t dataSize, char *out,
+                         size_t size) {
+  size_t in = 0;
+  size_t written = 0;
+
+  const auto readLength = [&](size_t &length) {
+    if (length != 15)
+      return true;
+    while (in < dataSize) {
+      const auto extra = static_cast<uint8_t>(data[in++]);
+      length += extra;
+      if (extra != 255)
+        return true;
+    }
+    return false;
+  };
+
+  while (in < dataSize) {
+    const auto token = static_cast<uint8_t>(data[in++]);
+
+    size_t numLiterals = token >> 4;
+    if (!readLength(numLiterals) || numLiterals > dataSize - in ||
+        numLiterals > size - written)
+      return false;
+    std::memcpy(out + written, data + in, numLiterals);
+    in += numLiterals;
+    written += numLiterals;
+
+    if (in == dataSize)
+      break;
+
+    if (dataSize - in < 2)
+      return false;
+    const auto offset = static_cast<size_t>(static_cast<uint8_t>(data[in])) |
+                        static_cast<size_t>(static_cast<uint8_t>(data[in + 1]))
+                            << 8;
+    in += 2;
+
+    size_t matchLength = token & 0xf;
+    if (!readLength(matchLength))
+      return false;
+    matchLength += LzMinMatch;
+
+    if (offset == 0 || offset > written || matchLength > size - written)
+      return false;
+
+    // Byte by byte, the match may overlap what it is copying
+    for (size_t i = 0; i < matchLength; i++, written++)
+      out[written] = out[written - offset];
+  }
+
+  return written == size;
+}
+
+// Replaces the sequence number and timestamp of each record by the
+// difference with the previous record's, or back, so consecutive record
+// headers are nearly identical and compress well
+template <bool Encode>
+void DeltaCodeRecords(char *payload, size_t size, size_t logDataSize) {
+  uint64_t previousSequenceNumber = 0;
+  uint64_t previousTimestamp = 0;
+
+  for (size_t offset = 0; size - offset >= sizeof(IndexedRecordHeader);) {
+    IndexedRecordHeader header;
+    std::memcpy(&header, payload + offset, sizeof(header));
+
+    const auto timestamp = static_cast<uint64_t>(header.mTimestamp);
+    if constexpr (Encode) {
+      header.mSequenceNumber -= previousSequenceNumber;
+      header.mTimestamp = static_cast<int64_t>(timestamp - previousTimestamp);
+      previousSequenceNumber += header.mSequenceNumber;
+      previousTimestamp = timestamp;
+    } else {
+      header.mSequenceNumber += previousSequenceNumber;
+      header.mTimestamp = static_cast<int64_t>(timestamp + previousTimestamp);
+      previousSequenceNumber = header.mSequenceNumber;
+      previousTimestamp = static_cast<uint64_t>(header.mTimestamp);
+    }
+
+    std::memcpy(payload + offset, &header, sizeof(header));
+    offset += sizeof(header);
+    if (size - offset < logDataSize + header.mMessageSize)
+      break;
+    offset += logDataSize + header.mMessageSize;
+  }
+}
+
+// A read only memory mapping of a whole file
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path) {
+#ifdef _WIN32
+    mFile = CreateFileA(path.c_str(), GENERIC_READ,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mFile == INVALID_HANDLE_VALUE)
+      return;
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+      return;
+
+    mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mMapping == nullptr)
+      return;
+
+    mData = static_cast<const std::byte *>(
+        MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    if (mData != nullptr)
+      mSize = static_cast<size_t>(size.QuadPart);
+#else
+    mFile = open(path.c_str(), O_RDONLY);
+    if (mFile < 0)
+      return;
+
+    struct stat status {};
+    if (fstat(mFile, &status) != 0 || status.st_size == 0)
+      return;
+
+    void *mapping = mmap(nullptr, static_cast<size_t>(status.st_size),
+                         PROT_READ, MAP_PRIVATE, mFile, 0);
+    if (mapping == MAP_FAILED)
+      return;
+
+    mData = static_cast<const std::byte *>(mapping);
+    mSize = static_cast<size_t>(status.st_size);
+#endif // _WIN32
+  }
+
+  ~MappedFile() {
+#ifdef _WIN32
+    if (mData != nullptr)
+      UnmapViewOfFile(mData);
+    if (mMapping != nullptr)
+      CloseHandle(mMapping);
+    if (mFile != INVALID_HANDLE_VALUE)
+      CloseHandle(mFile);
+#else
+    if (mData != nullptr)
+      munmap(const_cast<std::byte *>(mData), mSize);
+    if (mFile >= 0)
+      close(mFile);
+#endif // _WIN32
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&) = delete;
+  MappedFile &operator=(MappedFile &&) = delete;
+
+  const std::byte *data() const noexcept { return mData; }
+  size_t size() const noexcept { return mSize; }
+
+  // True if path names the mapped file, through whatever link or spelling
+  bool IsSameFileAs(const std::string &path) const {
+#ifdef _WIN32
+    HANDLE other = CreateFileA(
+        path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mFile == INVALID_HANDLE_VALUE || other == INVALID_HANDLE_VALUE) {
+      if (other != INVALID_HANDLE_VALUE)
+        CloseHandle(other);
+      return false;
+    }
+
+    BY_HANDLE_FILE_INFORMATION info{};
+    BY_HANDLE_FILE_INFORMATION otherInfo{};
+    const auto isSame =
+        GetFileInformationByHandle(mFile, &info) &&
+        GetFileInformationByHandle(other, &otherInfo) &&
+        info.dwVolumeSerialNumber == otherInfo.dwVolumeSerialNumber &&
+        info.nFileIndexHigh == otherInfo.nFileIndexHigh &&
+        info.nFileIndexLow == otherInfo.nFileIndexLow;
+    CloseHandle(other);
+    return isSame;
+#else
+    struct stat status {};
+    struct stat otherStatus {};
+    return mFile >= 0 && fstat(mFile, &status) == 0 &&
+           stat(path.c_str(), &otherStatus) == 0 &&
+           status.st_dev == otherStatus.st_dev &&
+           status.st_ino == otherStatus.st_ino;
+#endif // _WIN32
+  }
+
+private:
+#ifdef _WIN32
+  HANDLE mFile{INVALID_HANDLE_VALUE};
+  HANDLE mMapping{};
+#else
+  int mFile{-1};
+#endif // _WIN32
+  const std::byte *mData{};
+  size_t mSize{};
+};
+
+// Writes the file header, blocks, index and footer, tracking the index as it
+// goes
+class IndexedFileWriter {
+public:
+  IndexedFileWriter(const std::string &path, uint32_t logDataSize)
+      : mFile(path, std::ios::binary | std::ios::trunc),
+        mLogDataSize(logDataSize) {
+    IndexedFileHeader header;
+    header.mLogDataSize = logDataSize;
+    Write(&header, sizeof(header));
+  }
+
+  ~IndexedFileWriter() { Close(); }
+
+  IndexedFileWriter(const IndexedFileWriter &) = delete;
+  IndexedFileWriter &operator=(const IndexedFileWriter &) = delete;
+  IndexedFileWriter(IndexedFileWriter &&) = delete;
+  IndexedFileWriter &operator=(IndexedFileWriter &&) = delete;
+
+  bool IsOpen() const { return mFile.is_open() && mFile.good(); }
+
+  // Fills in the flags and sizes of header
+  void WriteBlock(IndexedBlockHeader header, const char *payload,
+                  size_t payloadSize, IndexedFileCompression compression) {
+    header.mFlags = 0;
+    header.mPayloadSize = static_cast<uint32_t>(payloadSize);
+    header.mStoredSize = header.mPayloadSize;
+
+    if (compression == IndexedFileCompression::Lz) {
+      mDeltaCoded.assign(payload, payload + payloadSize);
+      DeltaCodeRecords<true>(mDeltaCoded.data(), payloadSize, mLogDataSize);
+      LzCompress(mDeltaCoded.data(), payloadSize, mLzTable, mCompressed);
+      // Not worth it for incompressible data, store it as is
+      if (mCompressed.size() < payloadSize) {
+        header.mFlags |= IndexedBlockCompressed;
+        header.mStoredSize = static_cast<uint32_t>(mCompressed.size());
+        payload = mCompressed.data();
+      }
+    }
+
+    mIndex.push_back({mOffset, header.mMinSequenceNumber,
+                      header.mMaxSequenceNumber, header.mMinTimestamp,
+                      header.mMaxTimestamp});
+
+    Write(&header, sizeof(header));
+    Write(payload, header.mStoredSize);
+  }
+
+  void Flush() { mFile.flush(); }
+
+  void Close() {
+    if (!mFile.is_open())
+      return;
+
+    IndexedFileFooter footer;
+    footer.mIndexOffset = mOffset;
+    footer.mNumBlocks = mIndex.size();
+    Write(mIndex.data(), mIndex.size() * sizeof(IndexedFileBlock));
+    Write(&footer, sizeof(footer));
+
+    mFile.close();
+  }
+
+private:
+  void Write(const void *data, size_t size) {
+    mFile.write(static_cast<const char *>(data),
+                static_cast<std::streamsize>(size));
+    mOffset += size;
+  }
+
+  std::ofstream mFile;
+  size_t mLogDataSize{};
+  uint64_t mOffset{};
+  std::vector<IndexedFileBlock> mIndex{};
+  std::vector<char> mDeltaCoded{};
+  std::vector<char> mCompressed{};
+  std::vector<uint32_t> mLzTable{};
+};
+
+} // namespace detail
+
+/**
+ * @brief A PrintLogFn that writes an indexed binary log file.
+ *
+ * NOT REALTIME SAFE - run it on a LogProcessingThread, ideally behind its own
+ * SinkQueue.
+ *
+ * Records are stamped with the system_clock time at which the sink receives
+ * them, on the log processing thread, not when Log was called: the timestamp
+ * lags the event by however long the message waited in the queue, and time
+ * range queries are only as precise as that. Put a timestamp in LogData if
+ * you need the producer's time.
+ *
+ * Records are collected into blocks of roughly blockSize bytes. Each full
+ * block is written out, optionally compressed, with its sequence number and
+ * time range, Flush writes out a partial one. Close, also called on
+ * destruction, appends the index.
+ *
+ * A partial block only exists in memory, and is lost if the process crashes.
+ * To bound that loss the sink also writes out and flushes the current block
+ * when a record arrives and the block's first record is older than
+ * maxBlockAge. The age is only checked as records arrive, so the last records
+ * before a quiet period stay in memory until the next record, Flush or Close.
+ *
+ * @tparam LogData The type of the data to be logged. It is stored as raw bytes
+ * so it must be trivially copyable, read it back with
+ * IndexedFileReader::Record::GetLogData.
+ */
+template <typename LogData> class IndexedFileSink {
+public:
+  static_assert(std::is_trivially_copyable_v<LogData>,
+                "LogData must be trivially copyable to be stored in a file");
+
+  static constexpr size_t DefaultBlockSize = 64 * 1024;
+  static constexpr std::chrono::milliseconds DefaultMaxBlockAge{1000};
+
+  /**
+   * @param maxBlockAge How long records may wait in the current block before
+   * it is written out, see above. Zero writes every record out as it
+   * arrives, std::chrono::milliseconds::max() only full blocks.
+   */
+  explicit IndexedFileSink(
+      const std::string &path, size_t blockSize = DefaultBlockSize,
+      IndexedFileCompression compression = IndexedFileCompression::None,
+      std::chrono::milliseconds maxBlockAge = DefaultMaxBlockAge)
+      : mWriter(path, sizeof(LogData)), mBlockSize(blockSize),
+        mCompression(compression), mMaxBlockAge(maxBlockAge) {
+    mBlock.reserve(mBlockSize);
+  }
+
+  ~IndexedFileSink() { Close(); }
+
+  IndexedFileSink(const IndexedFileSink &) = delete;
+  IndexedFileSink &operator=(const IndexedFileSink &) = delete;
+  IndexedFileSink(IndexedFileSink &&) = delete;
+  IndexedFileSink &operator=(IndexedFileSink &&) = delete;
+
+  bool IsOpen() const { return mWriter.IsOpen(); }
+
+  void operator()(const LogData &data, size_t sequenceNumber,
+                  const char *fstring, ...) {
+    if (!IsOpen())
+      return;
+
+    va_list args;
+    va_start(args, fstring);
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    const auto length = std::vsnprintf(nullptr, 0, fstring, argsCopy);
+    va_end(argsCopy);
+
+    if (length > 0) {
+      mMessage.resize(static_cast<size_t>(length) + 1);
+      std::vsnprintf(mMessage.data(), mMessage.size(), fstring, args);
+    }
+    va_end(args);
+
+    const auto timestamp =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count();
+
+    AppendRecord(data, sequenceNumber, timestamp,
+                 std::string_view(mMessage.data(),
+                                  length > 0 ? static_cast<size_t>(length)
+                                             : 0));
+
+    // Cast down, so a maxBlockAge of milliseconds::max() does not overflow
+    const auto blockAge = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - mBlockStart);
+    if (blockAge >= mMaxBlockAge)
+      Flush();
+  }
+
+  /**
+   * @brief Writes out the current partial block, so everything received so far
+   * is readable.
+   */
+  void Flush() {
+    WriteBlock();
+    mWriter.Flush();
+  }
+
+  /**
+   * @brief Writes out the current partial block and the index, and closes the
+   * file.
+   */
+  void Close() {
+    WriteBlock();
+    mWriter.Close();
+  }
+
+private:
+  void AppendRecord(const LogData &data, uint64_t sequenceNumber,
+                    int64_t timestamp, std::string_view message) {
+    const auto recordSize = sizeof(detail::IndexedRecordHeader) +
+                            sizeof(LogData) + message.size();
+    if (mBlockHeader.mNumRecords > 0 &&
+        mBlock.size() + recordSize > mBlockSize)
+      WriteBlock();
+
+    detail::IndexedRecordHeader header;
+    header.mSequenceNumber = sequenceNumber;
+    header.mTimestamp = timestamp;
+    header.mMessageSize = static_cast<uint32_t>(message.size());
+
+    const auto *headerBytes = reinterpret_cast<const char *>(&header);
+    const auto *dataBytes = reinterpret_cast<const char *>(&data);
+    mBlock.insert(mBlock.end(), headerBytes, headerBytes + sizeof(header));
+    mBlock.insert(mBlock.end(), dataBytes, dataBytes + sizeof(LogData));
+    mBlock.insert(mBlock.end(), message.begin(), message.end());
+
+    auto &block = mBlockHeader;
+    if (block.mNumRecords == 0) {
+      mBlockStart = std::chrono::steady_clock::now();
+      block.mMinSequenceNumber = block.mMaxSequenceNumber = sequenceNumber;
+      block.mMinTimestamp = block.mMaxTimestamp = timestamp;
+    } else {
+      block.mMinSequenceNumber =
+          std::min<uint64_t>(block.mMinSequenceNumber, sequenceNumber);
+      block.mMaxSequenceNumber =
+          std::max<uint64_t>(block.mMaxSequenceNumber, sequenceNumber);
+      block.mMinTimestamp = std::min(block.mMinTimestamp, timestamp);
+      block.mMaxTimestamp = std::max(block.mMaxTimestamp, timestamp);
+    }
+    block.mNumRecords++;
+  }
+
+  void WriteBlock() {
+    if (mBlockHeader.mNumRecords == 0 || !IsOpen())
+      return;
+
+    mWriter.WriteBlock(mBlockHeader, mBlock.data(), mBlock.size(),
+                       mCompression);
+
+    mBlock.clear();
+    mBlockHeader = {};
+  }
+
+  detail::IndexedFileWriter mWriter;
+  size_t mBlockSize{};
+  IndexedFileCompression mCompression{};
+  std::chrono::milliseconds mMaxBlockAge{};
+
+  detail::IndexedBlockHeader mBlockHeader{};
+  std::chrono::steady_clock::time_point mBlockStart{};
+  std::vector<char> mBlock{};
+  std::vector<char> mMessage{};
+};
+
+/**
+ * @brief Reads an indexed binary log file written by IndexedFileSink.
+ *
+ * The file is memory mapped, the queries only decode (and decompress) the
+ * blocks whose range in the index overlaps the one asked for. The Records
+ * passed to the query callbacks are only valid for the duration of the call.
+ */
+class IndexedFileReader {
+public:
+  struct Record {
+    uint64_t mSequenceNumber{};
+    // Nanoseconds since the system_clock epoch, taken when the sink received
+    // the record rather than when it was logged
+    int64_t mTimestamp{};
+    const std::byte *mLogData{};
+    size_t mLogDataSize{};
+    std::string_view mMessage{};
+
+    template <typename LogData> LogData GetLogData() const {
+      static_assert(std::is_trivially_copyable_v<LogData>,
+                    "LogData must be trivially copyable");
+      LogData data{};
+      if (mLogDataSize == sizeof(LogData))
+        std::memcpy(&data, mLogData, sizeof(LogData));
+      return data;
+    }
+  };
+
+  explicit IndexedFileReader(const std::string &path) : mFile(path) {
+    detail::IndexedFileHeader header;
+    if (!detail::ReadAt(mFile.data(), mFile.size(), 0, header) ||
+        header.mMagic != detail::IndexedFileMagic ||
+        header.mVersion < detail::IndexedFileOldestVersion ||
+        header.mVersion > detail::IndexedFileVersion)
+      return;
+
+    mLogDataSize = header.mLogDataSize;
+    mIsValid = true;
+
+    if (!ReadIndex())
+      RebuildIndex();
+  }
+
+  /**
+   * @brief False if the file could not be mapped or is not an indexed log.
+   */
+  bool IsValid() const { return mIsValid; }
+
+  /**
+   * @brief False if the file was never closed and its index was rebuilt from
+   * the block headers.
+   */
+  bool HasIndex() const { return mHasIndex; }
+
+  const std::vector<IndexedFileBlock> &GetBlocks() const { return mBlocks; }
+
+  /**
+   * @brief Calls fn with every Record whose sequence number is in [first,
+   * last], in file order.
+   *
+   * @return size_t The number of blocks that had to be decoded.
+   */
+  template <typename Fn>
+  size_t ForEachInSequenceRange(uint64_t first, uint64_t last, Fn &&fn) const {
+    return Query(
+        [&](const IndexedFileBlock &block) {
+          return block.mMaxSequenceNumber >= first &&
+                 block.mMinSequenceNumber <= last;
+        },
+        [&](const Record &record) {
+          return record.mSequenceNumber >= first &&
+                 record.mSequenceNumber <= last;
+        },
+        fn);
+  }
+
+  /**
+   * @brief Calls fn with every Record whose timestamp is in [first, last]
+   * nanoseconds since the system_clock epoch, in file order. The timestamps
+   * are those of the sink, see IndexedFileSink.
+   *
+   * @return size_t The number of blocks that had to be decoded.
+   */
+  template <typename Fn>
+  size_t ForEachInTimeRange(int64_t first, int64_t last, Fn &&fn) const {
+    return Query(
+        [&](const IndexedFileBlock &block) {
+          return block.mMaxTimestamp >= first && block.mMinTimestamp <= last;
+        },
+        [&](const Record &record) {
+          return record.mTimestamp >= first && record.mTimestamp <= last;
+        },
+        fn);
+  }
+
+  /**
+   * @brief Writes a copy of the file with every block stored uncompressed,
+   * and an index.
+   *
+   * @return bool False if the file is not valid, outputPath is the file
+   * itself or could not be written.
+   */
+  bool WriteDecompressed(const std::string &outputPath) const {
+    // Opening the output truncates it, which would destroy the input
+    if (!mIsValid || mFile.IsSameFileAs(outputPath))
+      return false;
+
+    detail::IndexedFileWriter writer(outputPath,
+                                     static_cast<uint32_t>(mLogDataSize));
+    std::vector<char> scratch;
+    for (const auto &block : mBlocks) {
+      detail::IndexedBlockHeader header;
+      const std::byte *payload = nullptr;
+      if (GetPayload(block, header, payload, scratch))
+        writer.WriteBlock(header, reinterpret_cast<const char *>(payload),
+                          header.mPayloadSize, IndexedFileCompression::None);
+    }
+
+    const auto isWritten = writer.IsOpen();
+    writer.Close();
+    return isWritten;
+  }
+
+private:
+  bool ReadIndex() {
+    detail::IndexedFileFooter footer;
+    if (mFile.size() < sizeof(footer) ||
+        !detail::ReadAt(mFile.data(), mFile.size(),
+                        mFile.size() - sizeof(footer), footer) ||
+        footer.mMagic != detail::IndexedFileFooterMagic)
+      return false;
+
+    // Bound the block count first so a damaged footer cannot overflow the
+    // index size
+    const auto maxIndexSize = mFile.size() - sizeof(footer);
+    if (footer.mNumBlocks > maxIndexSize / sizeof(IndexedFileBlock) ||
+        footer.mIndexOffset > maxIndexSize)
+      return false;
+
+    const auto indexSize = footer.mNumBlocks * sizeof(IndexedFileBlock);
+    if (indexSize != maxIndexSize - footer.mIndexOffset)
+      return false;
+
+    mBlocks.resize(footer.mNumBlocks);
+    if (indexSize > 0)
+      std::memcpy(mBlocks.data(), mFile.data() + footer.mIndexOffset,
+                  indexSize);
+    mHasIndex = true;
+    return true;
+  }
+
+  void RebuildIndex() {
+    auto offset = sizeof(detail::IndexedFileHeader);
+    detail::IndexedBlockHeader header;
+    while (detail::ReadAt(mFile.data(), mFile.size(), offset, header) &&
+           header.mMagic == detail::IndexedBlockMagic &&
+           header.mStoredSize <= mFile.size() - offset - sizeof(header)) {
+      mBlocks.push_back({offset, header.mMinSequenceNumber,
+                         header.mMaxSequenceNumber, header.mMinTimestamp,
+                         header.mMaxTimestamp});
+      offset += sizeof(header) + header.mStoredSize;
+    }
+  }
+
+  // Points payload at the records of the block, decompressing them into
+  // scratch if needed, or returns false if the block is damaged
+  bool GetPayload(const IndexedFileBlock &block,
+                  detail::IndexedBlockHeader &header, const std::byte *&payload,
+                  std::vector<char> &scratch) const {
+    if (!detail::ReadAt(mFile.data(), mFile.size(), block.mOffset, header) ||
+        header.mMagic != detail::IndexedBlockMagic ||
+        header.mStoredSize >
+            mFile.size() - block.mOffset - sizeof(header))
+      return false;
+
+    const auto *stored = mFile.data() + block.mOffset + sizeof(header);
+    if ((header.mFlags & detail::IndexedBlockCompressed) == 0) {
+      payload = stored;
+      return header.mPayloadSize == header.mStoredSize;
+    }
+
+    scratch.resize(header.mPayloadSize);
+    payload = reinterpret_cast<const std::byte *>(scratch.data());
+    if (!detail::LzDecompress(stored, header.mStoredSize, scratch.data(),
+                              scratch.size()))
+      return false;
+
+    detail::DeltaCodeRecords<false>(scratch.data(), scratch.size(),
+                                    mLogDataSize);
+    return true;
+  }
+
+  template <typename BlockPredicate, typename RecordPredicate, typename Fn>
+  size_t Query(BlockPredicate &&blockMatches, RecordPredicate &&recordMatches,
+               Fn &fn) const {
+    size_t numDecoded = 0;
+    std::vector<char> scratch;
+
+    for (const auto &block : mBlocks) {
+      if (!blockMatches(block))
+        continue;
+
+      detail::IndexedBlockHeader header;
+      const std::byte *payload = nullptr;
+      if (!GetPayload(block, header, payload, scratch))
+        continue;
+      numDecoded++;
+
+      size_t offset = 0;
+      for (uint32_t i = 0; i < header.mNumRecords; i++) {
+        detail::IndexedRecordHeader recordHeader;
+        if (!detail::ReadAt(payload, header.mPayloadSize, offset,
+                            recordHeader))
+          break;
+        offset += sizeof(recordHeader);
+
+        if (header.mPayloadSize - offset <
+            mLogDataSize + static_cast<size_t>(recordHeader.mMessageSize))
+          break;
+
+        Record record;
+        record.mSequenceNumber = recordHeader.mSequenceNumber;
+        record.mTimestamp = recordHeader.mTimestamp;
+        record.mLogData = payload + offset;
+        record.mLogDataSize = mLogDataSize;
+        record.mMessage = std::string_view(
+            reinterpret_cast<const char *>(payload + offset + mLogDataSize),
+            recordHeader.mMessageSize);
+        offset += mLogDataSize + recordHeader.mMessageSize;
+
+        if (recordMatches(record))
+          fn(record);
+      }
+    }
+
+    return numDecoded;
+  }
+
+  detail::MappedFile mFile;
+  size_t mLogDataSize{};
+  bool mIsValid{};
+  bool mHasIndex{};
+  std::vector<IndexedFileBlock> mBlocks{};
+};
+
+} // namespace rtlog
@@ -1,12 +1,51 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstdarg>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <thread>
+#include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
+
+// ThreadOptions need pthreads. The CMake target defines RTLOG_HAS_PTHREADS
+// when it finds them, without CMake they are detected here.
+#if !defined(RTLOG_HAS_PTHREADS) && (defined(__unix__) || defined(__APPLE__))
+#if defined(__has_include)
+#if __has_include(<pthread.h>)
+#define RTLOG_HAS_PTHREADS
+#endif
+#endif
+#endif
+
+#ifdef RTLOG_HAS_PTHREADS
+#include <pthread.h>
+#include <sched.h>
+#endif // RTLOG_HAS_PTHREADS
+
+#if defined(RTLOG_ENABLE_INSTRUMENTATION) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif // __linux__
 
 #if !defined(RTLOG_USE_FMTLIB) && !defined(RTLOG_USE_STB)
 // The default behavior to match legacy behavior is to use STB
@@ -19,7 +58,22 @@
 
 #include <readerwriterqueue.h>
 
+// With RTLOG_COMPILED_LIBRARY (set by linking rtlog::rtlog_compiled) the non
+// template functions, and stb_sprintf, are only declared here. They are
+// compiled once into the library, by src/rtlog.cpp defining
+// RTLOG_IMPLEMENTATION, instead of into every translation unit.
+#if defined(RTLOG_COMPILED_LIBRARY) && !defined(RTLOG_IMPLEMENTATION)
+#define RTLOG_DECLARE_ONLY
+#endif
+
+#ifdef RTLOG_COMPILED_LIBRARY
+#define RTLOG_DETAIL_INLINE
+#else
+#define RTLOG_DETAIL_INLINE inline
+#endif
+
 #ifdef RTLOG_USE_STB
+#ifndef RTLOG_COMPILED_LIBRARY
 #ifndef STB_SPRINTF_IMPLEMENTATION
 #define STB_SPRINTF_IMPLEMENTATION
 #endif
@@ -27,6 +81,7 @@
 #ifndef STB_SPRINTF_STATIC
 #define STB_SPRINTF_STATIC
 #endif
+#endif // RTLOG_COMPILED_LIBRARY
 
 #include <stb_sprintf.h>
 #endif // RTLOG_USE_STB
@@ -41,12 +96,22 @@
 #define RTLOG_NONBLOCKING
 #endif
 
+// Destructive interference size used for padding. std::hardware_destructive_
+// interference_size is avoided as its value is not stable across compiler
+// flags, override this if your target has larger lines (e.g. 128 on Apple M1)
+#ifndef RTLOG_CACHE_LINE_SIZE
+#define RTLOG_CACHE_LINE_SIZE 64
+#endif
+
 #if defined(__GNUC__) || defined(__clang__)
-#define RTLOG_ATTRIBUTE_FORMAT __attribute__((format(printf, 3, 4)))
+#define RTLOG_ATTRIBUTE_FORMAT_AT(formatIndex, firstArgIndex)                  \
+  __attribute__((format(printf, formatIndex, firstArgIndex)))
 #else
-#define RTLOG_ATTRIBUTE_FORMAT
+#define RTLOG_ATTRIBUTE_FORMAT_AT(formatIndex, firstArgIndex)
 #endif
 
+#define RTLOG_ATTRIBUTE_FORMAT RTLOG_ATTRIBUTE_FORMAT_AT(3, 4)
+
 namespace rtlog {
 
 enum class Status {
@@ -54,16 +119,77 @@ enum class Status {
 
   Error_QueueFull = 1,
   Error_MessageTruncated = 2,
+  Error_BlobDropped = 3,
+  Error_BlobTruncated = 4,
+};
+
+inline constexpr std::size_t CacheLineSize = RTLOG_CACHE_LINE_SIZE;
+
+#ifdef _MSC_VER
+// Padding is the point of the types below: "structure was padded due to
+// alignment specifier"
+#pragma warning(push)
+#pragma warning(disable : 4324)
+#endif
+
+/**
+ * @brief A sequence counter that has a cache line to itself.
+ *
+ * The counter is hit by every Log call, sharing its line with unrelated globals
+ * means those writes and the consumer's reads keep stealing the line from the
+ * realtime thread. Use it anywhere a `std::atomic<std::size_t>` sequence number
+ * is accepted:
+ *
+ *     rtlog::PaddedSequenceNumber gSequenceNumber{0};
+ *     rtlog::Logger<LogData, 128, 256, gSequenceNumber> logger;
+ */
+struct alignas(CacheLineSize) PaddedSequenceNumber
+    : std::atomic<std::size_t> {
+  using std::atomic<std::size_t>::atomic;
 };
 
+static_assert(sizeof(PaddedSequenceNumber) == CacheLineSize);
+
 namespace detail {
 
-template <typename LogData, size_t MaxMessageLength> struct BasicLogData {
+struct BlobHandle {
+  static constexpr uint32_t InvalidBlock = std::numeric_limits<uint32_t>::max();
+
+  bool IsValid() const noexcept { return mBlock != InvalidBlock; }
+
+  uint32_t mBlock{InvalidBlock};
+  uint32_t mSize{};
+};
+
+template <typename LogData, size_t MaxMessageLength, bool WithBlobs = false>
+struct BasicLogData {
+  LogData mLogData{};
+  size_t mSequenceNumber{};
+  std::array<char, MaxMessageLength> mMessage{};
+};
+
+// Only loggers built for blobs carry a handle in every slot
+template <typename LogData, size_t MaxMessageLength>
+struct BasicLogData<LogData, MaxMessageLength, true> {
   LogData mLogData{};
   size_t mSequenceNumber{};
+  BlobHandle mBlob{};
   std::array<char, MaxMessageLength> mMessage{};
 };
 
+// Starts each wrapped value on its own cache line and rounds its size up to a
+// whole number of lines, so no two queue slots ever share one
+template <typename T> struct alignas(CacheLineSize) CacheLinePadded {
+  CacheLinePadded() = default;
+  explicit CacheLinePadded(T &&value) : mValue(std::move(value)) {}
+
+  T mValue{};
+};
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
 template <typename T, typename = void>
 struct has_try_enqueue_by_move : std::false_type {};
 
@@ -123,8 +249,884 @@ struct has_int_constructor<T, std::void_t<decltype(T(std::declval<int>()))>>
 
 template <typename T>
 inline constexpr bool has_int_constructor_v = has_int_constructor<T>::value;
+
+// The requirements on a QType, shared by every class that owns one. Check
+// them with static_assert(AssertValidQType<Q>::value).
+template <typename Q> struct AssertValidQType {
+  static_assert(
+      has_int_constructor_v<Q>,
+      "QType must have a constructor that takes an int - `QType(int)`");
+  static_assert(has_value_type_v<Q>,
+                "QType must have a value_type - `using value_type = T;`");
+  static_assert(has_try_enqueue_v<Q>,
+                "QType must have a try_enqueue method - `bool try_enqueue(T "
+                "&&item)` and/or `bool try_enqueue(const T &item)`");
+  static_assert(
+      has_try_dequeue_v<Q>,
+      "QType must have a try_dequeue method - `bool try_dequeue(T &item)`");
+
+  static constexpr bool value = true;
+};
+
+template <typename T, typename = void>
+struct has_max_num_messages : std::false_type {};
+
+template <typename T>
+struct has_max_num_messages<
+    T, std::void_t<decltype(std::declval<const T &>().GetMaxNumMessages())>>
+    : std::true_type {};
+
+template <typename T>
+inline constexpr bool has_max_num_messages_v = has_max_num_messages<T>::value;
+
+struct AcceptAllLogData {
+  template <typename LogData> bool operator()(const LogData &) const noexcept {
+    return true;
+  }
+};
+
+#ifdef RTLOG_USE_STB
+#ifdef RTLOG_DECLARE_ONLY
+int FastFormatMessage(char *buffer, size_t size, const char *format,
+                      va_list args) noexcept RTLOG_NONBLOCKING;
+int FormatMessage(char *buffer, size_t size, const char *format,
+                  va_list args) noexcept RTLOG_NONBLOCKING;
+#else
+inline constexpr char DigitPairs[] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+
+inline constexpr uint64_t PowersOfTen[] = {
+    1,      10,      100,      1000,      10000,
+    100000, 1000000, 10000000, 100000000, 1000000000};
+
+// Writes value right aligned so it ends at end, two digits at a time, and
+// returns where it starts
+inline char *WriteDecimal(uint64_t value, char *end) noexcept {
+  while (value >= 100) {
+    const auto pair = static_cast<size_t>(value % 100) * 2;
+    value /= 100;
+    end -= 2;
+    std::memcpy(end, DigitPairs + pair, 2);
+  }
+
+  if (value >= 10) {
+    end -= 2;
+    std::memcpy(end, DigitPairs + value * 2, 2);
+  } else
+    *--end = static_cast<char>('0' + value);
+
+  return end;
+}
+
+inline char *WriteHex(uint64_t value, char *end, bool upperCase) noexcept {
+  const char *digits = upperCase ? "0123456789ABCDEF" : "0123456789abcdef";
+  do {
+    *--end = digits[value & 0xf];
+    value >>= 4;
+  } while (value != 0);
+  return end;
+}
+
+// Rounds magnitude * 10^precision to the nearest integer. Fails, rather than
+// risk a result that differs from printf, when the double product is not
+// provably on the same side of a half as the exact one: below 2^40 its error
+// is under 2^-13, so anything further than 2^-11 from a half is safe.
+inline bool ScaleDecimal(double magnitude, int precision,
+                         uint64_t &scaled) noexcept {
+  constexpr double maxScaled = 1099511627776.0; // 2^40
+  constexpr double margin = 1.0 / 2048;
+
+  const auto product =
+      magnitude * static_cast<double>(PowersOfTen[precision]);
+  if (!(product < maxScaled))
+    return false;
+
+  const auto whole = std::floor(product);
+  const auto fraction = product - whole;
+  if (std::fabs(fraction - 0.5) <= margin)
+    return false;
+
+  scaled = static_cast<uint64_t>(whole) + (fraction > 0.5 ? 1 : 0);
+  return true;
+}
+
+struct FormatSpec {
+  bool mLeftAlign{};
+  bool mPlusSign{};
+  bool mSpaceSign{};
+  bool mZeroPad{};
+  size_t mWidth{};
+  int mPrecision{-1};
+};
+
+// Writes like snprintf: truncates to size - 1 characters but keeps counting
+class FormatWriter {
+public:
+  FormatWriter(char *buffer, size_t size) noexcept
+      : mBuffer(buffer), mSize(size) {}
+
+  void Put(const char *data, size_t length) noexcept {
+    if (mLength + 1 < mSize)
+      std::memcpy(mBuffer + mLength, data,
+                  std::min(length, mSize - 1 - mLength));
+    mLength += length;
+  }
+
+  void Fill(char c, size_t count) noexcept {
+    if (mLength + 1 < mSize)
+      std::memset(mBuffer + mLength, c, std::min(count, mSize - 1 - mLength));
+    mLength += count;
+  }
+
+  // Pads sign, leading zeros and body out to the width of spec
+  void PutField(const FormatSpec &spec, char sign, size_t leadingZeros,
+                const char *body, size_t bodyLength, bool zeroPad) noexcept {
+    const auto length = (sign != 0 ? 1 : 0) + leadingZeros + bodyLength;
+    const auto padding = spec.mWidth > length ? spec.mWidth - length : 0;
+    zeroPad = zeroPad && !spec.mLeftAlign;
+
+    if (!spec.mLeftAlign && !zeroPad)
+      Fill(' ', padding);
+    if (sign != 0)
+      Put(&sign, 1);
+    if (zeroPad)
+      Fill('0', padding);
+    Fill('0', leadingZeros);
+    Put(body, bodyLength);
+    if (spec.mLeftAlign)
+      Fill(' ', padding);
+  }
+
+  int Finish() noexcept {
+    if (mSize > 0)
+      mBuffer[std::min(mLength, mSize - 1)] = '\0';
+    return static_cast<int>(mLength);
+  }
+
+private:
+  char *mBuffer{};
+  size_t mSize{};
+  size_t mLength{};
+};
+
+/**
+ * @brief A printf subset specialized for the conversions log messages are
+ * made of: %d %i %u %x %X %f %g %s %c and %%, with the - + space 0 flags,
+ * width, precision and the hh h l ll z j t length modifiers.
+ *
+ * Integers are converted two digits at a time from a table, and %f / %g with
+ * up to 9 decimals go through an exactly rounded scaled integer instead of
+ * generic float to string conversion. Anything else, including the rare
+ * values too close to a rounding boundary to be sure of, formats the whole
+ * message with stbsp_vsnprintf instead. Integers and strings come out as
+ * stb_sprintf writes them; floats the kernel formats are rounded exactly,
+ * like glibc's printf, so they may differ from stb_sprintf's in the last
+ * digit.
+ *
+ * @return int The length of the full message, like vsnprintf
+ */
+RTLOG_DETAIL_INLINE int
+FastFormatMessage(char *buffer, size_t size, const char *format,
+                  va_list args) noexcept RTLOG_NONBLOCKING {
+  // Limits of what the fast path handles, beyond them it falls back
+  constexpr size_t maxWidth = 1024;
+  constexpr int maxPrecision = 9;
+  constexpr size_t maxIntegerPrecision = 64;
+
+  enum class Length {
+    Default,
+    Char,
+    Short,
+    Long,
+    LongLong,
+    Size,
+    Max,
+    Ptrdiff
+  };
+
+  FormatWriter out(buffer, size);
+  bool handled = true;
+
+  // args stays untouched for the fallback
+  va_list ap;
+  va_copy(ap, args);
+
+  for (const char *p = format; *p != '\0' && handled;) {
+    if (*p != '%') {
+      const char *literal = p;
+      while (*p != '\0' && *p != '%')
+        p++;
+      out.Put(literal, static_cast<size_t>(p - literal));
+      continue;
+    }
+
+    p++;
+    if (*p == '%') {
+      out.Put(p++, 1);
+      continue;
+    }
+
+    FormatSpec spec;
+    for (;; p++) {
+      if (*p == '-')
+        spec.mLeftAlign = true;
+      else if (*p == '+')
+        spec.mPlusSign = true;
+      else if (*p == ' ')
+        spec.mSpaceSign = true;
+      else if (*p == '0')
+        spec.mZeroPad = true;
+      else
+        break;
+    }
+
+    if (*p == '*') {
+      const auto width = va_arg(ap, int);
+      spec.mLeftAlign = spec.mLeftAlign || width < 0;
+      spec.mWidth = width < 0 ? 0 - static_cast<size_t>(width)
+                              : static_cast<size_t>(width);
+      p++;
+    } else
+      for (; *p >= '0' && *p <= '9' && spec.mWidth <= maxWidth; p++)
+        spec.mWidth = spec.mWidth * 10 + static_cast<size_t>(*p - '0');
+
+    if (*p == '.') {
+      p++;
+      spec.mPrecision = 0;
+      if (*p == '*') {
+        spec.mPrecision = std::max(va_arg(ap, int), -1);
+        p++;
+      } else
+        for (; *p >= '0' && *p <= '9' && spec.mPrecision <= 1000; p++)
+          spec.mPrecision = spec.mPrecision * 10 + (*p - '0');
+    }
+
+    auto length = Length::Default;
+    if (*p == 'h') {
+      p++;
+      length = *p == 'h' ? (p++, Length::Char) : Length::Short;
+    } else if (*p == 'l') {
+      p++;
+      length = *p == 'l' ? (p++, Length::LongLong) : Length::Long;
+    } else if (*p == 'z' || *p == 'j' || *p == 't') {
+      length = *p == 'z'   ? Length::Size
+               : *p == 'j' ? Length::Max
+                           : Length::Ptrdiff;
+      p++;
+    }
+
+    if (spec.mWidth > maxWidth) {
+      handled = false;
+      break;
+    }
+
+    // Big enough for any integer, or a float of up to 2^40 with 9 decimals
+    std::array<char, 32> digits;
+    char *end = digits.data() + digits.size();
+    char *start = end;
+
+    const auto conversion = *p++;
+    switch (conversion) {
+    case 'd':
+    case 'i': {
+      int64_t value = 0;
+      switch (length) {
+      case Length::Char:
+        value = static_cast<signed char>(va_arg(ap, int));
+        break;
+      case Length::Short:
+        value = static_cast<short>(va_arg(ap, int));
+        break;
+      case Length::Long:
+        value = va_arg(ap, long);
+        break;
+      case Length::LongLong:
+        value = va_arg(ap, long long);
+        break;
+      case Length::Size:
+        value = va_arg(ap, std::make_signed_t<size_t>);
+        break;
+      case Length::Max:
+        value = va_arg(ap, intmax_t);
+        break;
+      case Length::Ptrdiff:
+        value = va_arg(ap, ptrdiff_t);
+        break;
+      default:
+        value = va_arg(ap, int);
+        break;
+      }
+
+      const auto magnitude = value < 0 ? 0 - static_cast<uint64_t>(value)
+                                       : static_cast<uint64_t>(value);
+      const char sign = value < 0          ? '-'
+                        : spec.mPlusSign  ? '+'
+                        : spec.mSpaceSign ? ' '
+                                          : 0;
+
+      if (spec.mPrecision != 0 || magnitude != 0)
+        start = WriteDecimal(magnitude, end);
+
+      const auto numDigits = static_cast<size_t>(end - start);
+      const auto precision = static_cast<size_t>(spec.mPrecision);
+      if (spec.mPrecision > 0 && precision > maxIntegerPrecision) {
+        handled = false;
+        break;
+      }
+      out.PutField(spec, sign,
+                   spec.mPrecision > 0 && precision > numDigits
+                       ? precision - numDigits
+                       : 0,
+                   start, numDigits, spec.mZeroPad && spec.mPrecision < 0);
+      break;
+    }
+
+    case 'u':
+    case 'x':
+    case 'X': {
+      uint64_t value = 0;
+      switch (length) {
+      case Length::Char:
+        value = static_cast<unsigned char>(va_arg(ap, unsigned int));
+        break;
+      case Length::Short:
+        value = static_cast<unsigned short>(va_arg(ap, unsigned int));
+        break;
+      case Length::Long:
+        value = va_arg(ap, unsigned long);
+        break;
+      case Length::LongLong:
+        value = va_arg(ap, unsigned long long);
+        break;
+      case Length::Size:
+        value = va_arg(ap, size_t);
+        break;
+      case Length::Max:
+        value = va_arg(ap, uintmax_t);
+        break;
+      case Length::Ptrdiff:
+        value = static_cast<uint64_t>(va_arg(ap, ptrdiff_t));
+        break;
+      default:
+        value = va_arg(ap, unsigned int);
+        break;
+      }
+
+      if (spec.mPrecision != 0 || value != 0)
+        start = conversion == 'u' ? WriteDecimal(value, end)
+                                  : WriteHex(value, end, conversion == 'X');
+
+      const auto numDigits = static_cast<size_t>(end - start);
+      const auto precision = static_cast<size_t>(spec.mPrecision);
+      if (spec.mPrecision > 0 && precision > maxIntegerPrecision) {
+        handled = false;
+        break;
+      }
+      out.PutField(spec, 0,
+                   spec.mPrecision > 0 && precision > numDigits
+                       ? precision - numDigits
+                       : 0,
+                   start, numDigits, spec.mZeroPad && spec.mPrecision < 0);
+      break;
+    }
+
+    case 'f':
+    case 'g': {
+      if (length != Length::Default && length != Length::Long) {
+        handled = false;
+        break;
+      }
+
+      const auto value = va_arg(ap, double);
+      if (!std::isfinite(value)) {
+        handled = false;
+        break;
+      }
+      const auto magnitude = std::fabs(value);
+
+      int precision = spec.mPrecision < 0 ? 6 : spec.mPrecision;
+      uint64_t scaled = 0;
+
+      if (conversion == 'f') {
+        handled = precision <= maxPrecision &&
+                  ScaleDecimal(magnitude, precision, scaled);
+      } else {
+        // %g is %f with precision - 1 - exponent decimals when the exponent
+        // of the rounded value is in [-4, precision), trailing zeros removed
+        const auto significant = std::max(precision, 1);
+        auto exponent =
+            magnitude == 0.0
+                ? 0
+                : static_cast<int>(std::floor(std::log10(magnitude)));
+
+        handled = false;
+        for (int attempt = 0; attempt < 3 && significant <= maxPrecision;
+             attempt++) {
+          precision = significant - 1 - exponent;
+          if (exponent < -4 || exponent >= significant ||
+              precision > maxPrecision ||
+              !ScaleDecimal(magnitude, precision, scaled))
+            break;
+
+          if (scaled >= PowersOfTen[significant])
+            exponent++;
+          else if (magnitude != 0.0 && scaled < PowersOfTen[significant - 1])
+            exponent--;
+          else {
+            handled = true;
+            break;
+          }
+        }
+      }
+
+      if (!handled)
+        break;
+
+      const auto whole = scaled / PowersOfTen[precision];
+      auto fraction = scaled % PowersOfTen[precision];
+      if (conversion == 'g')
+        for (; precision > 0 && fraction % 10 == 0; precision--)
+          fraction /= 10;
+
+      if (precision > 0) {
+        start = WriteDecimal(fraction, end);
+        while (end - start < precision)
+          *--start = '0';
+        *--start = '.';
+      }
+      start = WriteDecimal(whole, start);
+
+      const char sign = std::signbit(value) ? '-'
+                        : spec.mPlusSign    ? '+'
+                        : spec.mSpaceSign   ? ' '
+                                            : 0;
+      out.PutField(spec, sign, 0, start, static_cast<size_t>(end - start),
+                   spec.mZeroPad);
+      break;
+    }
+
+    case 's': {
+      const char *string = va_arg(ap, const char *);
+      if (string == nullptr || length != Length::Default || spec.mZeroPad) {
+        handled = false;
+        break;
+      }
+
+      size_t stringLength = 0;
+      while ((spec.mPrecision < 0 ||
+              stringLength < static_cast<size_t>(spec.mPrecision)) &&
+             string[stringLength] != '\0')
+        stringLength++;
+
+      out.PutField(spec, 0, 0, string, stringLength, false);
+      break;
+    }
+
+    case 'c': {
+      const auto c = static_cast<char>(va_arg(ap, int));
+      if (length != Length::Default || spec.mZeroPad) {
+        handled = false;
+        break;
+      }
+      out.PutField(spec, 0, 0, &c, 1, false);
+      break;
+    }
+
+    default:
+      handled = false;
+      break;
+    }
+  }
+
+  va_end(ap);
+
+  if (!handled)
+    return stbsp_vsnprintf(buffer, static_cast<int>(size), format, args);
+  return out.Finish();
+}
+
+// Formats into buffer like vsnprintf, shared by every Logger instantiation
+RTLOG_DETAIL_INLINE int FormatMessage(char *buffer, size_t size,
+                                      const char *format,
+                                      va_list args) noexcept RTLOG_NONBLOCKING {
+#ifdef RTLOG_USE_FAST_FORMAT
+  return FastFormatMessage(buffer, size, format, args);
+#else
+  return stbsp_vsnprintf(buffer, static_cast<int>(size), format, args);
+#endif // RTLOG_USE_FAST_FORMAT
+}
+#endif // RTLOG_DECLARE_ONLY
+#endif // RTLOG_USE_STB
+} // namespace detail
+
+#ifdef RTLOG_ENABLE_INSTRUMENTATION
+#ifndef RTLOG_INSTRUMENTATION_MAX_CALL_SITES
+#define RTLOG_INSTRUMENTATION_MAX_CALL_SITES 256
+#endif
+
+/**
+ * @brief What the Log calls made from one call site, i.e. with one format
+ * string, have cost so far.
+ *
+ * Ticks come from the CPU timestamp counter where there is one (rdtsc on x86,
+ * cntvct_el0 on arm64) and are nanoseconds elsewhere. Compare them between
+ * call sites rather than converting them to time.
+ */
+struct CallSiteStats {
+  const char *mFormat{};
+  uint64_t mNumCalls{};
+  uint64_t mTotalTicks{};
+  uint64_t mMaxTicks{};
+  // Length of the formatted messages, including the part that was truncated
+  uint64_t mTotalLength{};
+  uint64_t mMaxLength{};
+};
+
+namespace detail {
+
+inline uint64_t ReadCycleCounter() noexcept RTLOG_NONBLOCKING {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+  uint64_t ticks;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+#endif
+}
+
+// Fixed size, lock free open addressing table of CallSiteStats keyed by the
+// format string pointer. Slots are claimed once and never freed, calls from
+// new call sites once it is full are only counted.
+class CallSiteTable {
+public:
+  static constexpr size_t Capacity = RTLOG_INSTRUMENTATION_MAX_CALL_SITES;
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "RTLOG_INSTRUMENTATION_MAX_CALL_SITES must be a power of 2");
+
+  void Record(const char *format, uint64_t ticks,
+              int length) noexcept RTLOG_NONBLOCKING {
+    // Fibonacci hashing, literals are too close together to use the low bits
+    const auto hash = static_cast<size_t>(
+        (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(format)) *
+         0x9e3779b97f4a7c15ull) >>
+        32);
+    for (size_t probe = 0; probe < Capacity; probe++) {
+      auto &slot = mSlots[(hash + probe) & (Capacity - 1)];
+
+      auto *key = slot.mFormat.load(std::memory_order_acquire);
+      if (key == nullptr &&
+          slot.mFormat.compare_exchange_strong(key, format,
+                                               std::memory_order_acq_rel))
+        key = format;
+
+      if (key != format)
+        continue;
+
+      const auto messageLength = static_cast<uint64_t>(std::max(length, 0));
+      slot.mNumCalls.fetch_add(1, std::memory_order_relaxed);
+      slot.mTotalTicks.fetch_add(ticks, std::memory_order_relaxed);
+      slot.mTotalLength.fetch_add(messageLength, std::memory_order_relaxed);
+      StoreMax(slot.mMaxTicks, ticks);
+      StoreMax(slot.mMaxLength, messageLength);
+      return;
+    }
+
+    mNumUntracked.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::vector<CallSiteStats> GetStats() const {
+    std::vector<CallSiteStats> stats;
+    for (const auto &slot : mSlots) {
+      const auto *format = slot.mFormat.load(std::memory_order_acquire);
+      if (format == nullptr)
+        continue;
+
+      stats.push_back({format, slot.mNumCalls.load(std::memory_order_relaxed),
+                       slot.mTotalTicks.load(std::memory_order_relaxed),
+                       slot.mMaxTicks.load(std::memory_order_relaxed),
+                       slot.mTotalLength.load(std::memory_order_relaxed),
+                       slot.mMaxLength.load(std::memory_order_relaxed)});
+    }
+    return stats;
+  }
+
+  uint64_t GetNumUntracked() const {
+    return mNumUntracked.load(std::memory_order_relaxed);
+  }
+
+private:
+  static void StoreMax(std::atomic<uint64_t> &max, uint64_t value) noexcept {
+    auto current = max.load(std::memory_order_relaxed);
+    while (value > current &&
+           !max.compare_exchange_weak(current, value,
+                                      std::memory_order_relaxed))
+      ;
+  }
+
+  struct Slot {
+    std::atomic<const char *> mFormat{nullptr};
+    std::atomic<uint64_t> mNumCalls{0};
+    std::atomic<uint64_t> mTotalTicks{0};
+    std::atomic<uint64_t> mMaxTicks{0};
+    std::atomic<uint64_t> mTotalLength{0};
+    std::atomic<uint64_t> mMaxLength{0};
+  };
+
+  std::array<Slot, Capacity> mSlots{};
+  std::atomic<uint64_t> mNumUntracked{0};
+};
+
+// Shared by all loggers, constant initialized so recording never hits a
+// static initialization guard
+inline CallSiteTable gCallSiteTable{};
+
+// Measures one Log call, from construction to destruction
+class CallSiteTimer {
+public:
+  explicit CallSiteTimer(const char *format) noexcept RTLOG_NONBLOCKING
+      : mFormat(format),
+        mStartTicks(ReadCycleCounter()) {}
+
+  ~CallSiteTimer() noexcept RTLOG_NONBLOCKING {
+    gCallSiteTable.Record(mFormat, ReadCycleCounter() - mStartTicks, mLength);
+  }
+
+  CallSiteTimer(const CallSiteTimer &) = delete;
+  CallSiteTimer &operator=(const CallSiteTimer &) = delete;
+
+  void SetLength(int length) noexcept { mLength = length; }
+
+private:
+  const char *mFormat{};
+  uint64_t mStartTicks{};
+  int mLength{};
+};
+
 } // namespace detail
 
+#ifdef RTLOG_DECLARE_ONLY
+std::vector<CallSiteStats> GetCallSiteStats(
+    size_t maxNumCallSites = detail::CallSiteTable::Capacity);
+uint64_t GetNumUntrackedCalls();
+void PrintCallSiteReport(std::FILE *file = stdout, size_t maxNumCallSites = 10);
+#else
+/**
+ * @brief Returns the cost of every call site logged from so far, most
+ * expensive in total first.
+ *
+ * NOT REALTIME SAFE - call it from the consumer side.
+ *
+ * @param maxNumCallSites Only return the top N.
+ */
+RTLOG_DETAIL_INLINE std::vector<CallSiteStats>
+GetCallSiteStats(size_t maxNumCallSites = detail::CallSiteTable::Capacity) {
+  auto stats = detail::gCallSiteTable.GetStats();
+  std::sort(stats.begin(), stats.end(),
+            [](const CallSiteStats &lhs, const CallSiteStats &rhs) {
+              return lhs.mTotalTicks > rhs.mTotalTicks;
+            });
+  if (stats.size() > maxNumCallSites)
+    stats.resize(maxNumCallSites);
+  return stats;
+}
+
+/**
+ * @brief Number of Log calls that were not tracked because every slot was
+ * taken, raise RTLOG_INSTRUMENTATION_MAX_CALL_SITES if this is not zero.
+ */
+RTLOG_DETAIL_INLINE uint64_t GetNumUntrackedCalls() {
+  return detail::gCallSiteTable.GetNumUntracked();
+}
+
+/**
+ * @brief Prints the top N call sites by total cost.
+ *
+ * NOT REALTIME SAFE - call it from the consumer side.
+ */
+RTLOG_DETAIL_INLINE void PrintCallSiteReport(std::FILE *file = stdout,
+                                             size_t maxNumCallSites = 10) {
+  std::fprintf(file, "%12s %14s %12s %12s %10s  %s\n", "calls", "total ticks",
+               "mean ticks", "max ticks", "mean len", "format");
+
+  for (const auto &site : GetCallSiteStats(maxNumCallSites)) {
+    const auto numCalls = std::max<uint64_t>(site.mNumCalls, 1);
+    std::fprintf(file, "%12llu %14llu %12llu %12llu %10llu  %s\n",
+                 static_cast<unsigned long long>(site.mNumCalls),
+                 static_cast<unsigned long long>(site.mTotalTicks),
+                 static_cast<unsigned long long>(site.mTotalTicks / numCalls),
+                 static_cast<unsigned long long>(site.mMaxTicks),
+                 static_cast<unsigned long long>(site.mTotalLength / numCalls),
+                 site.mFormat);
+  }
+
+  if (const auto numUntracked = GetNumUntrackedCalls())
+    std::fprintf(file, "%llu calls from untracked call sites\n",
+                 static_cast<unsigned long long>(numUntracked));
+}
+#endif // RTLOG_DECLARE_ONLY
+#endif // RTLOG_ENABLE_INSTRUMENTATION
+
+/**
+ * @brief A read only view of the binary payload attached to a log message.
+ *
+ * Only valid for the duration of the PrintLogFn call it was passed to, the
+ * block goes back to the BlobPool right after.
+ */
+struct BlobView {
+  bool empty() const noexcept { return mSize == 0; }
+
+  const std::byte *mData{};
+  size_t mSize{};
+};
+
+/**
+ * @brief A preallocated, lock-free pool of fixed size blocks for attaching
+ * binary payloads to log messages.
+ *
+ * Construct it (NOT REALTIME SAFE - it allocates) before your realtime thread
+ * starts, hand it to a Logger declared WithBlobs, and use Logger::LogWithBlob
+ * to copy a few hundred bytes of audio or a MIDI packet alongside a message
+ * instead of hex printing it. The consumer gets the bytes as a BlobView and
+ * the block is returned to the pool after the PrintLogFn call.
+ *
+ * Acquiring and releasing blocks is lock-free and may happen from any number of
+ * threads, so one pool can serve several loggers.
+ */
+class BlobPool {
+public:
+  // Block indices are 32 bit, the last value marks the end of the free list
+  static constexpr size_t MaxNumBlocks = detail::BlobHandle::InvalidBlock;
+  static constexpr size_t MaxBlockSize = std::numeric_limits<uint32_t>::max();
+
+  /**
+   * @param numBlocks The maximum number of blobs in flight at once, at most
+   * MaxNumBlocks.
+   * @param blockSize The maximum size of a single blob in bytes, larger blobs
+   * are truncated. At most MaxBlockSize.
+   */
+  BlobPool(size_t numBlocks, size_t blockSize)
+      : mNumBlocks(
+            static_cast<uint32_t>(std::min<size_t>(numBlocks, MaxNumBlocks))),
+        mBlockSize(
+            static_cast<uint32_t>(std::min<size_t>(blockSize, MaxBlockSize))),
+        mStorage(new std::byte[static_cast<size_t>(mNumBlocks) * mBlockSize]),
+        mNext(new std::atomic<uint32_t>[mNumBlocks]) {
+    for (uint32_t i = 0; i < mNumBlocks; i++)
+      mNext[i].store(i + 1 < mNumBlocks ? i + 1
+                                         : detail::BlobHandle::InvalidBlock,
+                     std::memory_order_relaxed);
+
+    mHead.store(Pack(mNumBlocks > 0 ? 0 : detail::BlobHandle::InvalidBlock, 0),
+                std::memory_order_release);
+  }
+
+  BlobPool(const BlobPool &) = delete;
+  BlobPool &operator=(const BlobPool &) = delete;
+  BlobPool(BlobPool &&) = delete;
+  BlobPool &operator=(BlobPool &&) = delete;
+
+  /**
+   * @brief Copies size bytes of data into a free block.
+   *
+   * REALTIME SAFE
+   *
+   * @return An invalid handle if every block is in use, otherwise a handle to
+   * the copied bytes. Its mSize is smaller than size if the blob was truncated
+   * to the block size.
+   */
+  detail::BlobHandle Store(const void *data,
+                           size_t size) noexcept RTLOG_NONBLOCKING {
+    detail::BlobHandle handle;
+
+    auto head = mHead.load(std::memory_order_acquire);
+    while (true) {
+      const auto block = Block(head);
+      if (block == detail::BlobHandle::InvalidBlock)
+        return handle;
+
+      const auto next = mNext[block].load(std::memory_order_relaxed);
+      if (mHead.compare_exchange_weak(head, Pack(next, Tag(head) + 1),
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+        handle.mBlock = block;
+        break;
+      }
+    }
+
+    handle.mSize = static_cast<uint32_t>(std::min<size_t>(size, mBlockSize));
+    std::memcpy(BlockData(handle.mBlock), data, handle.mSize);
+    return handle;
+  }
+
+  /**
+   * @brief Returns a block to the pool.
+   *
+   * REALTIME SAFE
+   */
+  void Release(detail::BlobHandle handle) noexcept RTLOG_NONBLOCKING {
+    if (!handle.IsValid())
+      return;
+
+    auto head = mHead.load(std::memory_order_relaxed);
+    do {
+      mNext[handle.mBlock].store(Block(head), std::memory_order_relaxed);
+    } while (!mHead.compare_exchange_weak(
+        head, Pack(handle.mBlock, Tag(head) + 1), std::memory_order_release,
+        std::memory_order_relaxed));
+  }
+
+  BlobView View(detail::BlobHandle handle) const noexcept {
+    if (!handle.IsValid())
+      return {};
+
+    return {BlockData(handle.mBlock), handle.mSize};
+  }
+
+  size_t GetBlockSize() const noexcept { return mBlockSize; }
+
+private:
+  // The free list head packs the block index with a tag bumped on every
+  // update, so a pop racing with a pop and push of the same block fails its
+  // compare exchange instead of corrupting the list (ABA)
+  static uint64_t Pack(uint32_t block, uint32_t tag) noexcept {
+    return (static_cast<uint64_t>(tag) << 32) | block;
+  }
+  static uint32_t Block(uint64_t head) noexcept {
+    return static_cast<uint32_t>(head);
+  }
+  static uint32_t Tag(uint64_t head) noexcept {
+    return static_cast<uint32_t>(head >> 32);
+  }
+
+  std::byte *BlockData(uint32_t block) const noexcept {
+    return mStorage.get() + static_cast<size_t>(block) * mBlockSize;
+  }
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                "BlobPool requires lock-free 64 bit atomics");
+
+  uint32_t mNumBlocks{};
+  uint32_t mBlockSize{};
+  std::unique_ptr<std::byte[]> mStorage;
+  std::unique_ptr<std::atomic<uint32_t>[]> mNext;
+  std::atomic<uint64_t> mHead{};
+};
+
 // On earlier versions of compilers (especially clang) you cannot
 // rely on defaulted template template parameters working as intended
 // This overload explicitly has 1 template paramter which is what
@@ -132,6 +1134,44 @@ inline constexpr bool has_int_constructor_v = has_int_constructor<T>::value;
 // the hardcoded MaxBlockSize
 template <typename T> using rtlog_SPSC = moodycamel::ReaderWriterQueue<T, 512>;
 
+/**
+ * @brief The default SPSC queue, with every slot aligned to and padded out to
+ * whole cache lines.
+ *
+ * With the default layout a slot is `sizeof(BasicLogData)` bytes, so slots
+ * straddle lines and the producer writing one slot can contend with the
+ * consumer reading its neighbour. Here each slot starts on a line boundary,
+ * which also places the LogData and sequence number header in the slot's first
+ * line. The cost is up to `CacheLineSize - 1` bytes of padding per slot.
+ *
+ * Pass it as the QType of a Logger:
+ *
+ *     rtlog::Logger<LogData, 128, 256, gSequenceNumber,
+ *                   rtlog::rtlog_SPSC_CacheAligned> logger;
+ */
+template <typename T> class rtlog_SPSC_CacheAligned {
+public:
+  using value_type = T;
+
+  explicit rtlog_SPSC_CacheAligned(int capacity)
+      : mQueue(static_cast<size_t>(capacity)) {}
+
+  bool try_enqueue(T &&item) { return mQueue.try_emplace(std::move(item)); }
+
+  bool try_dequeue(T &item) {
+    auto *front = mQueue.peek();
+    if (front == nullptr)
+      return false;
+
+    item = std::move(front->mValue);
+    mQueue.pop();
+    return true;
+  }
+
+private:
+  moodycamel::ReaderWriterQueue<detail::CacheLinePadded<T>, 512> mQueue;
+};
+
 /**
  * @brief A logger class for logging messages.
  * This class allows you to log messages of type LogData.
@@ -146,10 +1186,13 @@ template <typename T> using rtlog_SPSC = moodycamel::ReaderWriterQueue<T, 512>;
  * than this will be truncated and still enqueued
  * @tparam SequenceNumber This number is incremented when the message is
  * enqueued. It is assumed that your non-realtime logger increments and logs it
- * on Log.
+ * on Log. Usually a `std::atomic<std::size_t>`, or a PaddedSequenceNumber to
+ * keep it on its own cache line.
  * @tparam QType is the configurable underlying queue. By default it is a SPSC
  * queue from moodycamel. WARNING! It is up to the user to ensure this queue
  * type is real-time safe!!
+ * @tparam WithBlobs Whether messages can carry a blob from a BlobPool, see
+ * LogWithBlob. Off by default, as it adds a BlobHandle to every queue slot.
  *
  * Requirements on QType:
  *     1. Is real-time safe
@@ -160,24 +1203,31 @@ template <typename T> using rtlog_SPSC = moodycamel::ReaderWriterQueue<T, 512>;
  * try_enqueue(const T &item)` and `bool try_dequeue(T &item)`
  */
 template <typename LogData, size_t MaxNumMessages, size_t MaxMessageLength,
-          std::atomic<std::size_t> &SequenceNumber,
-          template <typename> class QType = rtlog_SPSC>
+          auto &SequenceNumber, template <typename> class QType = rtlog_SPSC,
+          bool WithBlobs = false>
 class Logger {
 public:
-  using InternalLogData = detail::BasicLogData<LogData, MaxMessageLength>;
+  using InternalLogData =
+      detail::BasicLogData<LogData, MaxMessageLength, WithBlobs>;
   using InternalQType = QType<InternalLogData>;
 
-  static_assert(
-      detail::has_int_constructor_v<InternalQType>,
-      "QType must have a constructor that takes an int - `QType(int)`");
-  static_assert(detail::has_value_type_v<InternalQType>,
-                "QType must have a value_type - `using value_type = T;`");
-  static_assert(detail::has_try_enqueue_v<InternalQType>,
-                "QType must have a try_enqueue method - `bool try_enqueue(T "
-                "&&item)` and/or `bool try_enqueue(const T &item)`");
-  static_assert(
-      detail::has_try_dequeue_v<InternalQType>,
-      "QType must have a try_dequeue method - `bool try_dequeue(T &item)`");
+  static_assert(std::is_base_of_v<std::atomic<std::size_t>,
+                                  std::decay_t<decltype(SequenceNumber)>>,
+                "SequenceNumber must be a std::atomic<std::size_t>");
+
+  static_assert(detail::AssertValidQType<InternalQType>::value);
+
+  Logger() = default;
+
+  /**
+   * @brief Constructs a Logger that can attach binary payloads from blobPool to
+   * its messages, see LogWithBlob.
+   *
+   * The pool must outlive the Logger. Only available on a Logger declared
+   * WithBlobs.
+   */
+  template <bool B = WithBlobs, std::enable_if_t<B, int> = 0>
+  explicit Logger(BlobPool &blobPool) : mBlobPool(&blobPool) {}
 
   /*
    * @brief Logs a message with the given format and input data.
@@ -208,30 +1258,8 @@ public:
 #ifdef RTLOG_USE_STB
   Status Logv(LogData &&inputData, const char *format,
               va_list args) noexcept RTLOG_NONBLOCKING {
-    auto retVal = Status::Success;
-
-    InternalLogData dataToQueue;
-    dataToQueue.mLogData = std::forward<LogData>(inputData);
-    dataToQueue.mSequenceNumber =
-        SequenceNumber.fetch_add(1, std::memory_order_relaxed);
-
-    const auto charsPrinted = stbsp_vsnprintf(
-        dataToQueue.mMessage.data(),
-        static_cast<int>(dataToQueue.mMessage.size()), format, args);
-
-    if (charsPrinted < 0 ||
-        static_cast<size_t>(charsPrinted) >= dataToQueue.mMessage.size())
-      retVal = Status::Error_MessageTruncated;
-
-    // Even if the message was truncated, we still try to enqueue it to minimize
-    // data loss
-    const bool dataWasEnqueued = mQueue.try_enqueue(std::move(dataToQueue));
-
-    if (!dataWasEnqueued)
-      retVal = Status::Error_QueueFull;
-
-    return retVal;
-  }
+    return LogvImpl(std::move(inputData), nullptr, 0, format, args);
+  }
 
   /*
    * @brief Logs a message with the given format and input data.
@@ -266,6 +1294,34 @@ public:
     va_end(args);
     return retVal;
   }
+
+  /*
+   * @brief Logs a message and attaches a copy of blobSize bytes of blob to it.
+   *
+   * REALTIME SAFE - except on systems where va_args allocates
+   *
+   * Same as Log, plus the bytes are copied into a block of the BlobPool this
+   * Logger was constructed with. The consumer receives them if its PrintLogFn
+   * can be called as `printLogFn(const LogData &, size_t sequenceNumber,
+   * rtlog::BlobView blob, const char *fstring, ...)`.
+   *
+   * @return Status As for Log. If the message itself was enqueued without error
+   * but the blob could not be attached, `Status::Error_BlobDropped` (no pool or
+   * pool exhausted) or `Status::Error_BlobTruncated` (larger than a block).
+   *
+   * Only available on a Logger declared WithBlobs.
+   */
+  // GCC only takes the format attribute in front on a template
+  template <bool B = WithBlobs, std::enable_if_t<B, int> = 0>
+  RTLOG_ATTRIBUTE_FORMAT_AT(5, 6)
+  Status LogWithBlob(LogData &&inputData, const void *blob, size_t blobSize,
+                     const char *format, ...) noexcept RTLOG_NONBLOCKING {
+    va_list args;
+    va_start(args, format);
+    auto retVal = LogvImpl(std::move(inputData), blob, blobSize, format, args);
+    va_end(args);
+    return retVal;
+  }
 #endif // RTLOG_USE_STB
 
 #ifdef RTLOG_USE_FMTLIB
@@ -300,6 +1356,171 @@ public:
   template <typename... T>
   Status Log(LogData &&inputData, fmt::format_string<T...> fmtString,
              T &&...args) noexcept RTLOG_NONBLOCKING {
+    return LogImpl<T...>(std::move(inputData), nullptr, 0, fmtString,
+                         std::forward<T>(args)...);
+  };
+
+  /**
+   * @brief Logs a message and attaches a copy of blobSize bytes of blob to it.
+   *
+   * REALTIME SAFE ON ALL SYSTEMS!
+   *
+   * See the printf-style LogWithBlob, this is its {fmt} counterpart.
+   */
+  template <bool B = WithBlobs, std::enable_if_t<B, int> = 0, typename... T>
+  Status LogWithBlob(LogData &&inputData, const void *blob, size_t blobSize,
+                     fmt::format_string<T...> fmtString,
+                     T &&...args) noexcept RTLOG_NONBLOCKING {
+    return LogImpl<T...>(std::move(inputData), blob, blobSize, fmtString,
+                         std::forward<T>(args)...);
+  }
+
+#endif // RTLOG_USE_FMTLIB
+
+  /**
+   * @brief Processes and prints all queued log data.
+   *
+   * ONLY REALTIME SAFE IF printLogFn IS REALTIME SAFE! - not generally the case
+   *
+   * This function processes and prints all queued log data. It takes a
+   * PrintLogFn object as input, which is used to print the log data.
+   *
+   * See tests and examples for some ideas on how to use this function. Using
+   * ctad you often don't need to specify the template parameter.
+   *
+   * If printLogFn can also be called with a BlobView after the sequence number,
+   * it is always called that way, with an empty view for messages without a
+   * blob. Blob blocks are returned to the pool once printLogFn returns.
+   *
+   * @tparam PrintLogFn The type of the print log function object.
+   * @param printLogFn The print log function object to be used to print the log
+   * data.
+   * @return int The number of log messages that were processed and printed.
+   */
+  template <typename PrintLogFn>
+  int PrintAndClearLogQueue(PrintLogFn &&printLogFn) {
+    int numProcessed = 0;
+
+    InternalLogData value;
+    while (mQueue.try_dequeue(value)) {
+      if constexpr (std::is_invocable_v<PrintLogFn &, const LogData &, size_t,
+                                        BlobView, const char *,
+                                        const char *>) {
+        auto blob = BlobView{};
+        if constexpr (WithBlobs)
+          if (mBlobPool != nullptr)
+            blob = mBlobPool->View(value.mBlob);
+        printLogFn(value.mLogData, value.mSequenceNumber, blob, "%s",
+                   value.mMessage.data());
+      } else
+        printLogFn(value.mLogData, value.mSequenceNumber, "%s",
+                   value.mMessage.data());
+
+      if constexpr (WithBlobs)
+        if (value.mBlob.IsValid())
+          mBlobPool->Release(value.mBlob);
+
+      numProcessed++;
+    }
+
+    return numProcessed;
+  }
+
+  /**
+   * @brief The number of messages that can be enqueued at once.
+   */
+  constexpr size_t GetMaxNumMessages() const noexcept { return MaxNumMessages; }
+
+private:
+  Status AttachBlob(InternalLogData &dataToQueue, const void *blob,
+                    size_t blobSize) noexcept RTLOG_NONBLOCKING {
+    // Only called WithBlobs, but every member is compiled by an explicit
+    // instantiation
+    if constexpr (WithBlobs) {
+      if (mBlobPool == nullptr)
+        return Status::Error_BlobDropped;
+
+      dataToQueue.mBlob = mBlobPool->Store(blob, blobSize);
+
+      if (!dataToQueue.mBlob.IsValid())
+        return Status::Error_BlobDropped;
+      if (dataToQueue.mBlob.mSize < blobSize)
+        return Status::Error_BlobTruncated;
+      return Status::Success;
+    } else {
+      (void)dataToQueue;
+      (void)blob;
+      (void)blobSize;
+      return Status::Error_BlobDropped;
+    }
+  }
+
+  Status Enqueue(InternalLogData &&dataToQueue,
+                 Status retVal) noexcept RTLOG_NONBLOCKING {
+    detail::BlobHandle blob;
+    if constexpr (WithBlobs)
+      blob = dataToQueue.mBlob;
+
+    // Even if the message was truncated, we still try to enqueue it to minimize
+    // data loss
+    const bool dataWasEnqueued = mQueue.try_enqueue(std::move(dataToQueue));
+
+    if (!dataWasEnqueued) {
+      if (blob.IsValid())
+        mBlobPool->Release(blob);
+      retVal = Status::Error_QueueFull;
+    }
+
+    return retVal;
+  }
+
+#ifdef RTLOG_USE_STB
+  Status LogvImpl(LogData &&inputData, const void *blob, size_t blobSize,
+                  const char *format,
+                  va_list args) noexcept RTLOG_NONBLOCKING {
+#ifdef RTLOG_ENABLE_INSTRUMENTATION
+    detail::CallSiteTimer callSiteTimer(format);
+#endif // RTLOG_ENABLE_INSTRUMENTATION
+
+    auto retVal = Status::Success;
+
+    InternalLogData dataToQueue;
+    dataToQueue.mLogData = std::forward<LogData>(inputData);
+    dataToQueue.mSequenceNumber =
+        SequenceNumber.fetch_add(1, std::memory_order_relaxed);
+
+    const auto charsPrinted = detail::FormatMessage(
+        dataToQueue.mMessage.data(), dataToQueue.mMessage.size(), format, args);
+#ifdef RTLOG_ENABLE_INSTRUMENTATION
+    callSiteTimer.SetLength(charsPrinted);
+#endif // RTLOG_ENABLE_INSTRUMENTATION
+
+    if (charsPrinted < 0 ||
+        static_cast<size_t>(charsPrinted) >= dataToQueue.mMessage.size())
+      retVal = Status::Error_MessageTruncated;
+
+    if constexpr (WithBlobs) {
+      if (blob != nullptr) {
+        const auto blobStatus = AttachBlob(dataToQueue, blob, blobSize);
+        if (retVal == Status::Success)
+          retVal = blobStatus;
+      }
+    }
+
+    return Enqueue(std::move(dataToQueue), retVal);
+  }
+#endif // RTLOG_USE_STB
+
+#ifdef RTLOG_USE_FMTLIB
+  template <typename... T>
+  Status LogImpl(LogData &&inputData, const void *blob, size_t blobSize,
+                 fmt::format_string<T...> fmtString,
+                 T &&...args) noexcept RTLOG_NONBLOCKING {
+#ifdef RTLOG_ENABLE_INSTRUMENTATION
+    detail::CallSiteTimer callSiteTimer(
+        static_cast<fmt::string_view>(fmtString).data());
+#endif // RTLOG_ENABLE_INSTRUMENTATION
+
     auto retVal = Status::Success;
 
     InternalLogData dataToQueue;
@@ -313,6 +1534,9 @@ public:
     const auto result =
         fmt::format_to_n(dataToQueue.mMessage.data(), maxMessageLength,
                          fmtString, std::forward<T>(args)...);
+#ifdef RTLOG_ENABLE_INSTRUMENTATION
+    callSiteTimer.SetLength(static_cast<int>(result.size));
+#endif // RTLOG_ENABLE_INSTRUMENTATION
 
     if (result.size >= dataToQueue.mMessage.size()) {
       dataToQueue.mMessage[dataToQueue.mMessage.size() - 1] = '\0';
@@ -320,59 +1544,538 @@ public:
     } else
       dataToQueue.mMessage[result.size] = '\0';
 
-    // Even if the message was truncated, we still try to enqueue it to minimize
-    // data loss
-    const bool dataWasEnqueued = mQueue.try_enqueue(std::move(dataToQueue));
+    if constexpr (WithBlobs) {
+      if (blob != nullptr) {
+        const auto blobStatus = AttachBlob(dataToQueue, blob, blobSize);
+        if (retVal == Status::Success)
+          retVal = blobStatus;
+      }
+    }
 
-    if (!dataWasEnqueued)
-      retVal = Status::Error_QueueFull;
+    return Enqueue(std::move(dataToQueue), retVal);
+  }
+#endif // RTLOG_USE_FMTLIB
+
+  InternalQType mQueue{MaxNumMessages};
+  BlobPool *mBlobPool{};
+};
+
+/**
+ * @brief Describes one size class of a SizeClassLogger.
+ *
+ * @tparam MaxNumMessages The number of messages of this class that can be
+ * enqueued at once.
+ * @tparam MaxMessageLength The maximum length of messages of this class.
+ * @tparam QType The underlying queue for this class, same requirements as for
+ * Logger.
+ */
+template <size_t MaxNumMessagesT, size_t MaxMessageLengthT,
+          template <typename> class QTypeT = rtlog_SPSC>
+struct SizeClass {
+  static constexpr size_t MaxNumMessages = MaxNumMessagesT;
+  static constexpr size_t MaxMessageLength = MaxMessageLengthT;
+  template <typename T> using QType = QTypeT<T>;
+};
+
+namespace detail {
+
+template <typename LogData, typename SizeClassT> class SizeClassQueue {
+public:
+  static constexpr size_t MaxMessageLength = SizeClassT::MaxMessageLength;
+
+  using InternalLogData = BasicLogData<LogData, MaxMessageLength>;
+  using InternalQType = typename SizeClassT::template QType<InternalLogData>;
+
+  static_assert(AssertValidQType<InternalQType>::value);
+
+  bool TryEnqueue(InternalLogData &&data) noexcept RTLOG_NONBLOCKING {
+    return mQueue.try_enqueue(std::move(data));
+  }
+
+  // Consumer side only: holds the oldest dequeued message of this class until
+  // it is its turn to be printed
+  bool FillPending() {
+    if (!mHasPending)
+      mHasPending = mQueue.try_dequeue(mPending);
+    return mHasPending;
+  }
+
+  bool HasPending() const { return mHasPending; }
+  size_t PendingSequenceNumber() const { return mPending.mSequenceNumber; }
+
+  template <typename PrintLogFn> void PrintPending(PrintLogFn &printLogFn) {
+    printLogFn(mPending.mLogData, mPending.mSequenceNumber, "%s",
+               mPending.mMessage.data());
+    mHasPending = false;
+  }
+
+private:
+  InternalQType mQueue{SizeClassT::MaxNumMessages};
+  InternalLogData mPending{};
+  bool mHasPending{false};
+};
+
+} // namespace detail
+
+/**
+ * @brief A logger that routes each message to the smallest size class that
+ * fits it.
+ *
+ * With a plain Logger every slot must be sized for the longest message you ever
+ * log. SizeClassLogger instead keeps one preallocated queue per SizeClass, so
+ * an occasional long diagnostic does not multiply the memory of the common
+ * short message:
+ *
+ *     rtlog::SizeClassLogger<LogData, gSequenceNumber,
+ *                            rtlog::SizeClass<512, 64>,
+ *                            rtlog::SizeClass<64, 256>,
+ *                            rtlog::SizeClass<4, 2048>> logger;
+ *
+ * Messages are formatted into the smallest class first; one that does not fit
+ * is formatted once more straight into the class that fits its now known
+ * length. Messages longer than the largest class are truncated into it. If the
+ * chosen class's queue is full the message is dropped, a full class does not
+ * spill into other classes.
+ *
+ * PrintAndClearLogQueue merges the queues back into sequence number order,
+ * also while the producer keeps logging. Like a Logger, it is used with
+ * LogProcessingThread or your own thread.
+ *
+ * @tparam LogData The type of the data to be logged.
+ * @tparam SequenceNumber As for Logger.
+ * @tparam SizeClasses One or more SizeClass, in strictly increasing
+ * MaxMessageLength.
+ */
+template <typename LogData, auto &SequenceNumber, typename... SizeClasses>
+class SizeClassLogger {
+public:
+  static constexpr size_t NumSizeClasses = sizeof...(SizeClasses);
+
+  static_assert(NumSizeClasses > 0, "At least one SizeClass is required");
+  static_assert(std::is_base_of_v<std::atomic<std::size_t>,
+                                  std::decay_t<decltype(SequenceNumber)>>,
+                "SequenceNumber must be a std::atomic<std::size_t>");
 
+#ifdef RTLOG_USE_STB
+  /*
+   * @brief Logs a message into the smallest size class that fits it, see
+   * Logger::Logv.
+   *
+   * REALTIME SAFE; you are supposed to allocate va_list in realtime safe
+   * manner, or expect that the system does not allocate va_args.
+   */
+  Status Logv(LogData &&inputData, const char *format,
+              va_list args) noexcept RTLOG_NONBLOCKING {
+    const auto sequenceNumber =
+        SequenceNumber.fetch_add(1, std::memory_order_relaxed);
+    return LogvInto<0>(std::move(inputData), sequenceNumber, 0, format, args);
+  }
+
+  /*
+   * @brief Logs a message into the smallest size class that fits it, see
+   * Logger::Log.
+   *
+   * REALTIME SAFE - except on systems where va_args allocates
+   */
+  Status Log(LogData &&inputData, const char *format,
+             ...) noexcept RTLOG_NONBLOCKING RTLOG_ATTRIBUTE_FORMAT {
+    va_list args;
+    va_start(args, format);
+    auto retVal = Logv(std::move(inputData), format, args);
+    va_end(args);
     return retVal;
-  };
+  }
+#endif // RTLOG_USE_STB
 
+#ifdef RTLOG_USE_FMTLIB
+  /**
+   * @brief Logs a message into the smallest size class that fits it, see
+   * Logger::Log.
+   *
+   * REALTIME SAFE ON ALL SYSTEMS!
+   */
+  template <typename... T>
+  Status Log(LogData &&inputData, fmt::format_string<T...> fmtString,
+             T &&...args) noexcept RTLOG_NONBLOCKING {
+    const auto sequenceNumber =
+        SequenceNumber.fetch_add(1, std::memory_order_relaxed);
+    // The arguments may be formatted twice, so they are type erased once here
+    // instead of being forwarded
+    return LogInto<0>(std::move(inputData), sequenceNumber, 0,
+                      fmt::string_view(fmtString),
+                      fmt::make_format_args(args...));
+  }
 #endif // RTLOG_USE_FMTLIB
 
   /**
-   * @brief Processes and prints all queued log data.
+   * @brief Processes and prints all queued log data of every size class, in
+   * sequence number order.
    *
    * ONLY REALTIME SAFE IF printLogFn IS REALTIME SAFE! - not generally the case
    *
-   * This function processes and prints all queued log data. It takes a
-   * PrintLogFn object as input, which is used to print the log data.
-   *
-   * See tests and examples for some ideas on how to use this function. Using
-   * ctad you often don't need to specify the template parameter.
-   *
-   * @tparam PrintLogFn The type of the print log function object.
-   * @param printLogFn The print log function object to be used to print the log
-   * data.
    * @return int The number of log messages that were processed and printed.
    */
   template <typename PrintLogFn>
   int PrintAndClearLogQueue(PrintLogFn &&printLogFn) {
     int numProcessed = 0;
 
-    InternalLogData value;
-    while (mQueue.try_dequeue(value)) {
-      printLogFn(value.mLogData, value.mSequenceNumber, "%s",
-                 value.mMessage.data());
+    while (true) {
+      auto oldest = std::numeric_limits<size_t>::max();
+      bool anyPending = false;
+      ForEachQueue([&](auto &queue) {
+        if (queue.FillPending()) {
+          anyPending = true;
+          oldest = std::min(oldest, queue.PendingSequenceNumber());
+        }
+      });
+
+      if (!anyPending)
+        break;
+
+      // A queue found empty above may have been filled since with an older
+      // message than the one just dequeued from a later queue. The producer
+      // enqueued it first and the dequeue acquired, so it is visible now.
+      ForEachQueue([&](auto &queue) {
+        if (!queue.HasPending() && queue.FillPending())
+          oldest = std::min(oldest, queue.PendingSequenceNumber());
+      });
+
+      bool printed = false;
+      ForEachQueue([&](auto &queue) {
+        if (!printed && queue.HasPending() &&
+            queue.PendingSequenceNumber() == oldest) {
+          queue.PrintPending(printLogFn);
+          printed = true;
+        }
+      });
       numProcessed++;
     }
 
     return numProcessed;
   }
 
+  /**
+   * @brief The number of messages that can be enqueued at once, over all size
+   * classes.
+   */
+  constexpr size_t GetMaxNumMessages() const noexcept {
+    return (SizeClasses::MaxNumMessages + ...);
+  }
+
 private:
-  InternalQType mQueue{MaxNumMessages};
+  using Queues = std::tuple<detail::SizeClassQueue<LogData, SizeClasses>...>;
+
+  template <size_t Index>
+  using QueueAt = std::tuple_element_t<Index, Queues>;
+
+  template <size_t Index = 0> static constexpr bool AreSizeClassesIncreasing() {
+    if constexpr (Index + 1 < NumSizeClasses)
+      return QueueAt<Index>::MaxMessageLength <
+                 QueueAt<Index + 1>::MaxMessageLength &&
+             AreSizeClassesIncreasing<Index + 1>();
+    else
+      return true;
+  }
+
+  static_assert(AreSizeClassesIncreasing(),
+                "SizeClasses must be in strictly increasing MaxMessageLength");
+
+  template <typename Fn> void ForEachQueue(Fn &&fn) {
+    std::apply([&](auto &...queue) { (fn(queue), ...); }, mQueues);
+  }
+
+  template <size_t Index>
+  Status Enqueue(typename QueueAt<Index>::InternalLogData &&dataToQueue,
+                 Status retVal) noexcept RTLOG_NONBLOCKING {
+    // Even if the message was truncated, we still try to enqueue it to
+    // minimize data loss
+    if (!std::get<Index>(mQueues).TryEnqueue(std::move(dataToQueue)))
+      retVal = Status::Error_QueueFull;
+
+    return retVal;
+  }
+
+  // requiredLength is 0 until a format attempt has told us the real length
+  // of the message, at which point every class too small for it is skipped
+#ifdef RTLOG_USE_STB
+  template <size_t Index>
+  Status LogvInto(LogData &&inputData, size_t sequenceNumber,
+                  size_t requiredLength, const char *format,
+                  va_list args) noexcept RTLOG_NONBLOCKING {
+    if constexpr (Index + 1 < NumSizeClasses) {
+      if (requiredLength >= QueueAt<Index>::MaxMessageLength)
+        return LogvInto<Index + 1>(std::move(inputData), sequenceNumber,
+                                   requiredLength, format, args);
+    }
+
+    auto retVal = Status::Success;
+
+    typename QueueAt<Index>::InternalLogData dataToQueue;
+    dataToQueue.mLogData = std::move(inputData);
+    dataToQueue.mSequenceNumber = sequenceNumber;
+
+    // args may need to be walked again for a larger class
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    const auto charsPrinted =
+        detail::FormatMessage(dataToQueue.mMessage.data(),
+                              dataToQueue.mMessage.size(), format, argsCopy);
+    va_end(argsCopy);
+
+    if (charsPrinted < 0 ||
+        static_cast<size_t>(charsPrinted) >= dataToQueue.mMessage.size()) {
+      if constexpr (Index + 1 < NumSizeClasses) {
+        if (charsPrinted >= 0)
+          return LogvInto<Index + 1>(std::move(dataToQueue.mLogData),
+                                     sequenceNumber,
+                                     static_cast<size_t>(charsPrinted), format,
+                                     args);
+      }
+      retVal = Status::Error_MessageTruncated;
+    }
+
+    return Enqueue<Index>(std::move(dataToQueue), retVal);
+  }
+#endif // RTLOG_USE_STB
+
+#ifdef RTLOG_USE_FMTLIB
+  template <size_t Index>
+  Status LogInto(LogData &&inputData, size_t sequenceNumber,
+                 size_t requiredLength, fmt::string_view fmtString,
+                 fmt::format_args args) noexcept RTLOG_NONBLOCKING {
+    if constexpr (Index + 1 < NumSizeClasses) {
+      if (requiredLength >= QueueAt<Index>::MaxMessageLength)
+        return LogInto<Index + 1>(std::move(inputData), sequenceNumber,
+                                  requiredLength, fmtString, args);
+    }
+
+    auto retVal = Status::Success;
+
+    typename QueueAt<Index>::InternalLogData dataToQueue;
+    dataToQueue.mLogData = std::move(inputData);
+    dataToQueue.mSequenceNumber = sequenceNumber;
+
+    const auto maxMessageLength =
+        dataToQueue.mMessage.size() - 1; // Account for null terminator
+
+    const auto result = fmt::vformat_to_n(dataToQueue.mMessage.data(),
+                                          maxMessageLength, fmtString, args);
+
+    if (result.size >= dataToQueue.mMessage.size()) {
+      if constexpr (Index + 1 < NumSizeClasses)
+        return LogInto<Index + 1>(std::move(dataToQueue.mLogData),
+                                  sequenceNumber, result.size, fmtString,
+                                  args);
+
+      dataToQueue.mMessage[dataToQueue.mMessage.size() - 1] = '\0';
+      retVal = Status::Error_MessageTruncated;
+    } else
+      dataToQueue.mMessage[result.size] = '\0';
+
+    return Enqueue<Index>(std::move(dataToQueue), retVal);
+  }
+#endif // RTLOG_USE_FMTLIB
+
+  Queues mQueues{};
+};
+
+/**
+ * @brief Bounds for a LogProcessingThread that adapts its wait time to how fast
+ * the queue is filling.
+ *
+ * After every pass the thread measures how many messages it drained and how
+ * long it took them to arrive, and picks the wait that would let the queue
+ * reach roughly a quarter of its capacity by the next pass, clamped to
+ * [mMinWaitTime, mMaxWaitTime]. When nothing arrives the wait doubles towards
+ * mMaxWaitTime, so an idle logger costs next to nothing. If a single pass
+ * drains at least mSpinFillRatio of the capacity the queue is close to
+ * overflowing, so the thread stops sleeping and only yields until the load
+ * drops again.
+ *
+ * The capacity is taken from `GetMaxNumMessages()` of the logger. For loggers
+ * without it the wait halves after a pass that found messages and doubles after
+ * one that did not, and the thread never spins.
+ *
+ * LogProcessingThread puts invalid bounds back in order: a negative
+ * mMinWaitTime is raised to zero and an mMaxWaitTime below it raised to it.
+ */
+struct AdaptiveWaitTime {
+  std::chrono::microseconds mMinWaitTime{100};
+  std::chrono::microseconds mMaxWaitTime{std::chrono::milliseconds(50)};
+  // In (0, 1]; above 1 the thread never spins. Anything not above 0 would
+  // spin after every pass that found a message, and is replaced by the
+  // default.
+  double mSpinFillRatio{0.5};
+};
+
+/**
+ * @brief Where and how a LogProcessingThread runs.
+ *
+ * Keep the processing thread off the cores of your realtime threads, and give
+ * it enough priority that it is not starved until the queue overflows. Every
+ * setting is optional, anything left unset is inherited from the creating
+ * thread as with a plain std::thread.
+ *
+ * Requires RTLOG_HAS_PTHREADS, which the CMake target defines when pthreads
+ * are available, and which is otherwise detected on Unix like systems that
+ * have <pthread.h>. Without it none of the options can be applied.
+ * CPU affinity and the nice value are Linux only.
+ */
+struct ThreadOptions {
+  // The CPUs the thread may run on
+  std::vector<int> mCpuAffinity{};
+  // SCHED_OTHER, SCHED_FIFO, SCHED_RR, ...
+  std::optional<int> mSchedulingPolicy{};
+  // The sched_priority used with mSchedulingPolicy
+  int mPriority{};
+  std::optional<int> mNiceValue{};
+  // Truncated to the 15 characters Linux allows
+  std::string mName{};
+};
+
+namespace detail {
+
+// Applies options to the calling thread, and reads back what the thread
+// actually ended up with. Returns false if any requested setting failed.
+#ifdef RTLOG_DECLARE_ONLY
+bool ApplyThreadOptions(const ThreadOptions &options, ThreadOptions &actual);
+#else
+RTLOG_DETAIL_INLINE bool ApplyThreadOptions(const ThreadOptions &options,
+                                            ThreadOptions &actual) {
+  bool applied = true;
+
+#ifdef RTLOG_HAS_PTHREADS
+  const auto self = pthread_self();
+
+  if (!options.mName.empty()) {
+#ifdef __APPLE__
+    applied &= pthread_setname_np(options.mName.substr(0, 15).c_str()) == 0;
+#else
+    applied &=
+        pthread_setname_np(self, options.mName.substr(0, 15).c_str()) == 0;
+#endif // __APPLE__
+  }
+
+  if (options.mSchedulingPolicy.has_value()) {
+    sched_param param{};
+    param.sched_priority = options.mPriority;
+    applied &=
+        pthread_setschedparam(self, *options.mSchedulingPolicy, &param) == 0;
+  }
+
+#ifdef __linux__
+  const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+
+  if (!options.mCpuAffinity.empty()) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (const auto cpu : options.mCpuAffinity)
+      CPU_SET(cpu, &cpus);
+    applied &= pthread_setaffinity_np(self, sizeof(cpus), &cpus) == 0;
+  }
+
+  // On Linux the nice value is per thread
+  if (options.mNiceValue.has_value())
+    applied &= setpriority(PRIO_PROCESS, tid, *options.mNiceValue) == 0;
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  if (pthread_getaffinity_np(self, sizeof(cpus), &cpus) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      if (CPU_ISSET(cpu, &cpus))
+        actual.mCpuAffinity.push_back(cpu);
+  }
+
+  actual.mNiceValue = getpriority(PRIO_PROCESS, tid);
+#else
+  applied &= options.mCpuAffinity.empty() && !options.mNiceValue.has_value();
+#endif // __linux__
+
+  int policy = 0;
+  sched_param param{};
+  if (pthread_getschedparam(self, &policy, &param) == 0) {
+    actual.mSchedulingPolicy = policy;
+    actual.mPriority = param.sched_priority;
+  }
+
+  std::array<char, 16> name{};
+  if (pthread_getname_np(self, name.data(), name.size()) == 0)
+    actual.mName = name.data();
+#else
+  (void)actual;
+  applied = options.mCpuAffinity.empty() &&
+            !options.mSchedulingPolicy.has_value() &&
+            !options.mNiceValue.has_value() && options.mName.empty();
+#endif // RTLOG_HAS_PTHREADS
+
+  return applied;
+}
+#endif // RTLOG_DECLARE_ONLY
+
+// The wait after a pass that drained numProcessed messages, which arrived over
+// elapsedSeconds, see AdaptiveWaitTime. capacity is the logger's
+// GetMaxNumMessages(), or 0 for loggers without it.
+#ifdef RTLOG_DECLARE_ONLY
+std::chrono::microseconds NextAdaptiveWaitTime(const AdaptiveWaitTime &bounds,
+                                               std::chrono::microseconds wait,
+                                               int numProcessed,
+                                               size_t capacity,
+                                               double elapsedSeconds);
+#else
+RTLOG_DETAIL_INLINE std::chrono::microseconds
+NextAdaptiveWaitTime(const AdaptiveWaitTime &bounds,
+                     std::chrono::microseconds wait, int numProcessed,
+                     size_t capacity, double elapsedSeconds) {
+  using namespace std::chrono;
+
+  // The fill level we aim for when the next pass happens
+  constexpr double targetFillRatio = 0.25;
+
+  if (numProcessed == 0)
+    return std::clamp(wait * 2, bounds.mMinWaitTime, bounds.mMaxWaitTime);
+
+  if (capacity == 0)
+    return std::max(wait / 2, bounds.mMinWaitTime);
+
+  const auto capacityMessages = static_cast<double>(capacity);
+  if (numProcessed >= bounds.mSpinFillRatio * capacityMessages)
+    return microseconds::zero();
+
+  const auto messagesPerSecond = numProcessed / std::max(elapsedSeconds, 1e-6);
+  const auto timeToTarget =
+      duration<double>(targetFillRatio * capacityMessages / messagesPerSecond);
+  return std::clamp(duration_cast<microseconds>(timeToTarget),
+                    bounds.mMinWaitTime, bounds.mMaxWaitTime);
+}
+#endif // RTLOG_DECLARE_ONLY
+
+// Forwards to a PrintLogFn, remembering the highest sequence number it has
+// been handed. Only invocable the ways PrintLogFn is, so the BlobView overload
+// is still picked up.
+template <typename PrintLogFn> struct SequenceTrackingPrintFn {
+  template <typename LogData, typename... Args>
+  auto operator()(const LogData &data, size_t sequenceNumber, Args &&...args)
+      -> decltype(std::declval<PrintLogFn &>()(data, sequenceNumber,
+                                               std::forward<Args>(args)...)) {
+    if (!mHighestSequenceNumber.has_value() ||
+        sequenceNumber > *mHighestSequenceNumber)
+      mHighestSequenceNumber = sequenceNumber;
+    return mPrintFn(data, sequenceNumber, std::forward<Args>(args)...);
+  }
+
+  PrintLogFn &mPrintFn;
+  std::optional<size_t> mHighestSequenceNumber{};
 };
 
+} // namespace detail
+
 /**
  * @brief A class representing a log processing thread.
  *
  * This class represents a log processing thread that continuously dequeues log
  * data from a LoggerType object and calls a PrintLogFn object to print the log
  * data. The wait time between each log processing iteration can be specified in
- * milliseconds.
+ * milliseconds, or adapted to the load with AdaptiveWaitTime.
  *
  * @tparam LoggerType The type of the logger object to be used for log
  * processing.
@@ -380,6 +2083,20 @@ private:
  */
 template <typename LoggerType, typename PrintLogFn> class LogProcessingThread {
 public:
+  /**
+   * @brief A snapshot of what the processing thread has been doing.
+   */
+  struct Stats {
+    size_t mNumProcessed{};
+    size_t mNumWakeups{};
+    // Zero while spinning
+    std::chrono::microseconds mCurrentWaitTime{};
+    // What the thread actually runs with, as read back from the OS at startup
+    ThreadOptions mThreadSettings{};
+    // False if any of the requested ThreadOptions could not be applied
+    bool mThreadOptionsApplied{};
+  };
+
   /**
    * @brief Constructs a new LogProcessingThread object.
    *
@@ -401,11 +2118,36 @@ public:
    * @param printFn The print log function object to be used to print the log
    * data.
    * @param waitTime The time to wait between each log processing iteration.
+   * @param threadOptions Affinity, scheduling and name of the thread. The
+   * constructor returns once the thread has applied them.
    */
   LogProcessingThread(LoggerType &logger, PrintLogFn &printFn,
-                      std::chrono::milliseconds waitTime)
-      : mPrintFn(printFn), mLogger(logger), mWaitTime(waitTime) {
-    mThread = std::thread(&LogProcessingThread::ThreadMain, this);
+                      std::chrono::milliseconds waitTime,
+                      ThreadOptions threadOptions = {})
+      : mPrintFn{printFn}, mLogger(logger), mWaitTime(waitTime) {
+    mCurrentWaitTime.store(mWaitTime);
+    Start(std::move(threadOptions));
+  }
+
+  /**
+   * @brief Constructs a new LogProcessingThread object that adapts its wait
+   * time to the load, see AdaptiveWaitTime.
+   */
+  LogProcessingThread(LoggerType &logger, PrintLogFn &printFn,
+                      AdaptiveWaitTime waitTime,
+                      ThreadOptions threadOptions = {})
+      : mPrintFn{printFn}, mLogger(logger) {
+    // std::clamp is undefined with the bounds out of order
+    waitTime.mMinWaitTime =
+        std::max(waitTime.mMinWaitTime, std::chrono::microseconds::zero());
+    waitTime.mMaxWaitTime =
+        std::max(waitTime.mMaxWaitTime, waitTime.mMinWaitTime);
+    if (!(waitTime.mSpinFillRatio > 0.0))
+      waitTime.mSpinFillRatio = AdaptiveWaitTime{}.mSpinFillRatio;
+
+    mAdaptiveWaitTime = waitTime;
+    mCurrentWaitTime.store(waitTime.mMinWaitTime);
+    Start(std::move(threadOptions));
   }
 
   ~LogProcessingThread() {
@@ -415,7 +2157,74 @@ public:
     }
   }
 
-  void Stop() { mShouldRun.store(false); }
+  /**
+   * @brief What a Flush with a timeout got to.
+   */
+  struct FlushResult {
+    // False if the timeout expired before the flush was done
+    bool mCompleted{};
+    // The highest sequence number printFn had been called with when the last
+    // completed flush was done, std::nullopt if none was
+    std::optional<size_t> mFlushedSequenceNumber{};
+  };
+
+  /**
+   * @brief Asks the thread to stop. It wakes up right away, does a last pass
+   * over the logger and exits.
+   *
+   * NOT SIGNAL SAFE - this takes a lock to wake the thread up, do not call it
+   * from a signal handler.
+   */
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mShouldRun.store(false);
+    }
+    mWakeUp.notify_one();
+  }
+
+  /**
+   * @brief Wakes the thread and blocks until every message enqueued before this
+   * call has been handed to printFn.
+   *
+   * NOT REALTIME SAFE - this takes a lock and waits on the processing thread.
+   * NOT SIGNAL SAFE either, do not call it from a signal handler. Do not call
+   * it from printFn. Once the thread has stopped it returns right away,
+   * whatever is still in the logger is not printed.
+   *
+   * This waits for as long as printFn takes. Where that must be bounded, e.g.
+   * on the way down after a crash, use the overload with a timeout.
+   *
+   * @return std::optional<size_t> The highest sequence number printFn has been
+   * called with, or std::nullopt if it has not been called yet.
+   */
+  std::optional<size_t> Flush() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    const auto request = RequestFlush();
+    mFlushed.wait(lock, [&] { return IsFlushed(request); });
+    return mFlushedSequenceNumber;
+  }
+
+  /**
+   * @brief Like Flush, but gives up waiting after timeout, e.g. when printFn
+   * is stuck on a slow disk. The flush still completes later if the thread
+   * gets to it.
+   */
+  template <typename Rep, typename Period>
+  FlushResult Flush(std::chrono::duration<Rep, Period> timeout) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    const auto request = RequestFlush();
+    const auto isCompleted =
+        mFlushed.wait_for(lock, timeout, [&] { return IsFlushed(request); });
+    return {isCompleted, mFlushedSequenceNumber};
+  }
+
+  Stats GetStats() const {
+    return {mNumProcessed.load(std::memory_order_relaxed),
+            mNumWakeups.load(std::memory_order_relaxed),
+            mCurrentWaitTime.load(std::memory_order_relaxed), mThreadSettings,
+            mThreadOptionsApplied};
+  }
 
   LogProcessingThread(const LogProcessingThread &) = delete;
   LogProcessingThread &operator=(const LogProcessingThread &) = delete;
@@ -423,27 +2232,315 @@ public:
   LogProcessingThread &operator=(LogProcessingThread &&) = delete;
 
 private:
+  // Both with mMutex held
+  uint64_t RequestFlush() {
+    mWakeUp.notify_one();
+    return ++mFlushRequested;
+  }
+
+  bool IsFlushed(uint64_t request) const {
+    return mFlushCompleted >= request || mHasExited;
+  }
+
+  void Start(ThreadOptions threadOptions) {
+    std::atomic<bool> hasStarted{false};
+    mThread = std::thread([this, &threadOptions, &hasStarted]() {
+      mThreadOptionsApplied =
+          detail::ApplyThreadOptions(threadOptions, mThreadSettings);
+      hasStarted.store(true, std::memory_order_release);
+      ThreadMain();
+    });
+
+    // Wait so the settings are in place and readable before we return
+    while (!hasStarted.load(std::memory_order_acquire))
+      std::this_thread::yield();
+  }
+
   void ThreadMain() {
+    if (mAdaptiveWaitTime.has_value())
+      RunAdaptive(*mAdaptiveWaitTime);
+    else
+      RunFixed();
+
+    Drain();
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mHasExited = true;
+    }
+    mFlushed.notify_all();
+  }
+
+  void RunFixed() {
     while (mShouldRun.load()) {
 
-      if (mLogger.PrintAndClearLogQueue(mPrintFn) == 0)
-        std::this_thread::sleep_for(mWaitTime);
+      if (Drain() == 0)
+        Wait(mWaitTime);
 
-      std::this_thread::sleep_for(mWaitTime);
+      Wait(mWaitTime);
     }
+  }
+
+  // Sleeps for waitTime, or less if asked to stop or flush
+  template <typename Duration> void Wait(Duration waitTime) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mWakeUp.wait_for(lock, waitTime, [&] {
+      return !mShouldRun.load() || mFlushRequested != mFlushCompleted;
+    });
+  }
 
-    mLogger.PrintAndClearLogQueue(mPrintFn);
+  void RunAdaptive(const AdaptiveWaitTime &bounds) {
+    using namespace std::chrono;
+
+    size_t capacity = 0;
+    if constexpr (detail::has_max_num_messages_v<LoggerType>)
+      capacity = mLogger.GetMaxNumMessages();
+
+    auto waitTime = bounds.mMinWaitTime;
+    auto lastPass = steady_clock::now();
+
+    while (mShouldRun.load()) {
+      const auto numProcessed = Drain();
+      const auto now = steady_clock::now();
+      const auto elapsed = duration<double>(now - lastPass).count();
+      lastPass = now;
+
+      waitTime = detail::NextAdaptiveWaitTime(bounds, waitTime, numProcessed,
+                                              capacity, elapsed);
+      mCurrentWaitTime.store(waitTime, std::memory_order_relaxed);
+
+      if (waitTime == microseconds::zero())
+        std::this_thread::yield();
+      else
+        Wait(waitTime);
+    }
   }
 
-  PrintLogFn &mPrintFn{};
+  int Drain() {
+    // Anything enqueued before a flush was requested is in the queue by now,
+    // so this pass covers it
+    uint64_t flushRequested = 0;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      flushRequested = mFlushRequested;
+    }
+
+    const auto numProcessed = mLogger.PrintAndClearLogQueue(mPrintFn);
+    mNumProcessed.fetch_add(static_cast<size_t>(numProcessed),
+                            std::memory_order_relaxed);
+    mNumWakeups.fetch_add(1, std::memory_order_relaxed);
+
+    if (flushRequested != mFlushCompleted) {
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFlushCompleted = flushRequested;
+        mFlushedSequenceNumber = mPrintFn.mHighestSequenceNumber;
+      }
+      mFlushed.notify_all();
+    }
+
+    return numProcessed;
+  }
+
+  detail::SequenceTrackingPrintFn<PrintLogFn> mPrintFn;
   LoggerType &mLogger{};
   std::thread mThread{};
   std::atomic<bool> mShouldRun{true};
   std::chrono::milliseconds mWaitTime{};
+  std::optional<AdaptiveWaitTime> mAdaptiveWaitTime{};
+
+  std::atomic<size_t> mNumProcessed{0};
+  std::atomic<size_t> mNumWakeups{0};
+  std::atomic<std::chrono::microseconds> mCurrentWaitTime{};
+
+  std::mutex mMutex{};
+  std::condition_variable mWakeUp{};
+  std::condition_variable mFlushed{};
+  // Guarded by mMutex, only the thread writes mFlushCompleted
+  uint64_t mFlushRequested{};
+  uint64_t mFlushCompleted{};
+  std::optional<size_t> mFlushedSequenceNumber{};
+  bool mHasExited{};
+
+  // Written once by the thread before the constructor returns
+  ThreadOptions mThreadSettings{};
+  bool mThreadOptionsApplied{};
 };
 
 template <typename LoggerType, typename PrintLogFn>
 LogProcessingThread(LoggerType &, PrintLogFn)
     -> LogProcessingThread<LoggerType, PrintLogFn>;
 
+/**
+ * @brief A bounded buffer sitting in front of a single sink.
+ *
+ * A SinkQueue is itself a valid PrintLogFn, so it can be handed to
+ * PrintAndClearLogQueue, a LogProcessingThread or a FanOut. Every message it
+ * receives that passes FilterFn is copied into its own queue, which is then
+ * drained like a Logger - typically by a dedicated LogProcessingThread calling
+ * the real sink. A slow sink therefore only fills its own SinkQueue; once full,
+ * further messages are dropped and counted instead of blocking the caller.
+ *
+ * NOT REALTIME SAFE to push into - it is meant to be fed from the thread
+ * draining a Logger, not from the realtime thread.
+ *
+ * @tparam LogData The type of the data to be logged.
+ * @tparam MaxNumMessages The maximum number of messages buffered for this sink.
+ * @tparam MaxMessageLength The maximum length of each message. Messages longer
+ * than this will be truncated and still enqueued
+ * @tparam FilterFn A callable `bool(const LogData &)`, messages for which it
+ * returns false are not forwarded to this sink. Accepts everything by default.
+ * @tparam QType The underlying queue, same requirements as for Logger. The
+ * default is single producer, so only one thread may push into a SinkQueue.
+ */
+template <typename LogData, size_t MaxNumMessages, size_t MaxMessageLength,
+          typename FilterFn = detail::AcceptAllLogData,
+          template <typename> class QType = rtlog_SPSC>
+class SinkQueue {
+public:
+  using InternalLogData = detail::BasicLogData<LogData, MaxMessageLength>;
+  using InternalQType = QType<InternalLogData>;
+
+  static_assert(detail::AssertValidQType<InternalQType>::value);
+
+  explicit SinkQueue(FilterFn filterFn = FilterFn{})
+      : mFilterFn(std::move(filterFn)) {}
+
+  SinkQueue(const SinkQueue &) = delete;
+  SinkQueue &operator=(const SinkQueue &) = delete;
+  SinkQueue(SinkQueue &&) = delete;
+  SinkQueue &operator=(SinkQueue &&) = delete;
+
+  /**
+   * @brief Formats and buffers a message for this sink, keeping its original
+   * sequence number.
+   *
+   * @return Status `Status::Success` if the message was buffered or filtered
+   * out, `Status::Error_QueueFull` if it was dropped because this sink is
+   * backed up, `Status::Error_MessageTruncated` if it was buffered but did not
+   * fit.
+   */
+  Status Pushv(const LogData &inputData, size_t sequenceNumber,
+               const char *format, va_list args) {
+    if (!mFilterFn(inputData))
+      return Status::Success;
+
+    auto retVal = Status::Success;
+
+    InternalLogData dataToQueue;
+    dataToQueue.mLogData = inputData;
+    dataToQueue.mSequenceNumber = sequenceNumber;
+
+    const auto charsPrinted =
+        std::vsnprintf(dataToQueue.mMessage.data(),
+                       dataToQueue.mMessage.size(), format, args);
+
+    if (charsPrinted < 0 ||
+        static_cast<size_t>(charsPrinted) >= dataToQueue.mMessage.size())
+      retVal = Status::Error_MessageTruncated;
+
+    if (!mQueue.try_enqueue(std::move(dataToQueue))) {
+      mNumDropped.fetch_add(1, std::memory_order_relaxed);
+      retVal = Status::Error_QueueFull;
+    }
+
+    return retVal;
+  }
+
+  void operator()(const LogData &inputData, size_t sequenceNumber,
+                  const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    Pushv(inputData, sequenceNumber, format, args);
+    va_end(args);
+  }
+
+  /**
+   * @brief Hands all buffered messages to printLogFn, see
+   * Logger::PrintAndClearLogQueue.
+   *
+   * @return int The number of log messages that were processed and printed.
+   */
+  template <typename PrintLogFn>
+  int PrintAndClearLogQueue(PrintLogFn &&printLogFn) {
+    int numProcessed = 0;
+
+    InternalLogData value;
+    while (mQueue.try_dequeue(value)) {
+      printLogFn(value.mLogData, value.mSequenceNumber, "%s",
+                 value.mMessage.data());
+      numProcessed++;
+    }
+
+    return numProcessed;
+  }
+
+  /**
+   * @brief The number of messages that can be buffered at once.
+   */
+  constexpr size_t GetMaxNumMessages() const noexcept { return MaxNumMessages; }
+
+  /**
+   * @brief The number of messages dropped because this sink's queue was full.
+   */
+  size_t GetNumDropped() const noexcept {
+    return mNumDropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  FilterFn mFilterFn;
+  InternalQType mQueue{MaxNumMessages};
+  std::atomic<size_t> mNumDropped{0};
+};
+
+/**
+ * @brief A PrintLogFn that forwards every message to several sinks.
+ *
+ * Each sink must provide `Pushv(const LogData &, size_t, const char *,
+ * va_list)`, SinkQueue being the intended one. Pair each SinkQueue with its
+ * own LogProcessingThread so a stalled sink never delays the others or the
+ * thread draining the realtime Logger:
+ *
+ *     rtlog::SinkQueue<LogData, 256, 256> consoleQueue, fileQueue;
+ *     rtlog::FanOut fanOut(consoleQueue, fileQueue);
+ *     rtlog::LogProcessingThread drain(logger, fanOut, 1ms);
+ *     rtlog::LogProcessingThread console(consoleQueue, consolePrinter, 10ms);
+ *     rtlog::LogProcessingThread file(fileQueue, filePrinter, 10ms);
+ *
+ * NOT REALTIME SAFE - the sinks are only referenced, they must outlive the
+ * FanOut.
+ *
+ * @tparam Sinks The types of the sinks to forward to.
+ */
+template <typename... Sinks> class FanOut {
+public:
+  explicit FanOut(Sinks &...sinks) : mSinks(sinks...) {}
+
+  template <typename LogData>
+  void operator()(const LogData &inputData, size_t sequenceNumber,
+                  const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    std::apply(
+        [&](auto &...sink) {
+          (PushTo(sink, inputData, sequenceNumber, format, args), ...);
+        },
+        mSinks);
+    va_end(args);
+  }
+
+private:
+  template <typename Sink, typename LogData>
+  static void PushTo(Sink &sink, const LogData &inputData,
+                     size_t sequenceNumber, const char *format, va_list args) {
+    // Every sink consumes the arguments, so each one gets its own copy
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    sink.Pushv(inputData, sequenceNumber, format, argsCopy);
+    va_end(argsCopy);
+  }
+
+  std::tuple<Sinks &...> mSinks;
+};
+
 } // namespace rtlog
@@ -0,0 +1,10 @@
+// The single copy of the non template parts of rtlog, and of stb_sprintf,
+// shared by every target linking rtlog::rtlog_compiled. See RTLOG_DECLARE_ONLY
+// in rtlog.h.
+#define RTLOG_IMPLEMENTATION
+
+#ifdef RTLOG_USE_STB
+#define STB_SPRINTF_IMPLEMENTATION
+#endif // RTLOG_USE_STB
+
+#include <rtlog/rtlog.h>
@@ -0,0 +1,523 @@
+#include <rtlog/rtlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Runs one Logger and LogProcessingThread per producer for a while, under CPU
+// hogs, bursts and a slow sink, and checks that every message either arrives,
+// in order and intact, or was reported as dropped by Log. Each message carries
+// the number dropped before it, so a message lost or reordered without Log
+// reporting it is caught where it happens.
+
+namespace rtlog::soak {
+
+constexpr auto MAX_LOG_MESSAGE_LENGTH = 128;
+constexpr auto MAX_NUM_LOG_MESSAGES = 1024;
+
+struct Options {
+  double mSeconds{10.0};
+  int mNumProducers{4};
+  int mNumHogs{static_cast<int>(std::thread::hardware_concurrency())};
+  // Larger than the queue, so every burst overflows it
+  int mBurstSize{MAX_NUM_LOG_MESSAGES * 4};
+  int mSinkDelayUs{200};
+  int mWaitMs{1};
+  bool mAdaptiveWait{};
+  bool mCacheAligned{};
+  bool mSizeClasses{};
+  bool mExpectDrops{};
+};
+
+struct SoakLogData {
+  int mProducer;
+  uint64_t mIndex;
+  // How many of the producer's messages Log had dropped before this one
+  uint64_t mNumDropped;
+};
+
+// Shared by all producers, as in most programs, so the counter is contended
+// too. Each producer's messages only have to be increasing, the totals are
+// checked against it at the end.
+std::atomic<std::size_t> gSequenceNumber{0};
+
+template <template <typename> class QType>
+using SoakLogger =
+    rtlog::Logger<SoakLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
+                  gSequenceNumber, QType>;
+
+// Every other message only fits the larger class, so the processing thread
+// merges both queues all the time
+template <template <typename> class QType>
+using SoakSizeClassLogger = rtlog::SizeClassLogger<
+    SoakLogData, gSequenceNumber,
+    rtlog::SizeClass<MAX_NUM_LOG_MESSAGES, 64, QType>,
+    rtlog::SizeClass<MAX_NUM_LOG_MESSAGES / 2, MAX_LOG_MESSAGE_LENGTH, QType>>;
+
+const char *MessageTail(uint64_t index) {
+  return index % 2 == 0 ? "" : ", and a tail only the larger class fits";
+}
+
+// Log2 buckets of the time spent in each Log call, bucket i holds
+// [2^i, 2^(i+1)) ns
+struct LatencyHistogram {
+  static constexpr size_t NumBuckets = 48;
+
+  void Add(uint64_t nanoseconds) {
+    size_t bucket = 0;
+    while (bucket + 1 < NumBuckets && (nanoseconds >> (bucket + 1)) != 0)
+      bucket++;
+    mBuckets[bucket]++;
+    mCount++;
+    mMax = std::max(mMax, nanoseconds);
+  }
+
+  void Merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < NumBuckets; i++)
+      mBuckets[i] += other.mBuckets[i];
+    mCount += other.mCount;
+    mMax = std::max(mMax, other.mMax);
+  }
+
+  // The upper bound of the bucket holding the given fraction of the calls
+  uint64_t Percentile(double fraction) const {
+    const auto target = static_cast<uint64_t>(fraction * mCount);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NumBuckets; i++) {
+      seen += mBuckets[i];
+      if (seen > target)
+        return uint64_t{2} << i;
+    }
+    return mMax;
+  }
+
+  std::array<uint64_t, NumBuckets> mBuckets{};
+  uint64_t mCount{};
+  uint64_t mMax{};
+};
+
+// Checks what one producer's processing thread hands to it, and every so
+// often takes its time to simulate a sink stuck on I/O
+class CheckingSink {
+public:
+  CheckingSink(int producer, int delayUs)
+      : mProducer(producer), mDelay(delayUs) {}
+
+  void operator()(const SoakLogData &data, size_t sequenceNumber,
+                  const char *fstring, ...) {
+    std::array<char, MAX_LOG_MESSAGE_LENGTH> message{};
+    va_list args;
+    va_start(args, fstring);
+    vsnprintf(message.data(), message.size(), fstring, args);
+    va_end(args);
+
+    if (mLastSequenceNumber.has_value() &&
+        sequenceNumber <= *mLastSequenceNumber)
+      Error("sequence number %zu after %zu", sequenceNumber,
+            *mLastSequenceNumber);
+    mLastSequenceNumber = sequenceNumber;
+
+    if (data.mProducer != mProducer)
+      Error("message from producer %d", data.mProducer);
+
+    // Exactly the messages Log dropped in between may be missing, the
+    // producer counted each drop before logging its next message
+    const auto numMissing = data.mNumDropped - mLastNumDropped;
+    const auto expectedIndex =
+        mNumReceived > 0 ? mLastIndex + 1 + numMissing : numMissing;
+    if (mNumReceived > 0 && data.mIndex <= mLastIndex) {
+      // Keeps checking against the newest one, a late message is one error
+      Error("index %" PRIu64 " after %" PRIu64, data.mIndex, mLastIndex);
+    } else {
+      if (data.mIndex != expectedIndex)
+        Error("index %" PRIu64 ", expected %" PRIu64 " with %" PRIu64
+              " dropped in between",
+              data.mIndex, expectedIndex, numMissing);
+      mLastIndex = data.mIndex;
+      mLastNumDropped = data.mNumDropped;
+    }
+
+    std::array<char, MAX_LOG_MESSAGE_LENGTH> expected{};
+    snprintf(expected.data(), expected.size(),
+             "producer %d message %" PRIu64 " gain %.3f%s", data.mProducer,
+             data.mIndex, static_cast<double>(data.mIndex % 1000) * 0.001,
+             MessageTail(data.mIndex));
+    if (std::strcmp(message.data(), expected.data()) != 0)
+      Error("message \"%s\", expected \"%s\"", message.data(),
+            expected.data());
+
+    mNumReceived++;
+    if (mDelay.count() > 0 && mNumReceived % 256 == 0)
+      std::this_thread::sleep_for(mDelay);
+  }
+
+  uint64_t GetNumReceived() const { return mNumReceived; }
+  uint64_t GetLastIndex() const { return mLastIndex; }
+  size_t GetNumErrors() const { return mNumErrors; }
+
+private:
+  template <typename... Args> void Error(const char *format, Args... args) {
+    // Only the first few, a broken queue would otherwise flood the output
+    if (mNumErrors++ < 10) {
+      fprintf(stderr, "producer %d: ", mProducer);
+      fprintf(stderr, format, args...);
+      fprintf(stderr, "\n");
+    }
+  }
+
+  int mProducer{};
+  std::chrono::microseconds mDelay{};
+  std::optional<size_t> mLastSequenceNumber{};
+  uint64_t mLastIndex{};
+  uint64_t mLastNumDropped{};
+  uint64_t mNumReceived{};
+  size_t mNumErrors{};
+};
+
+template <typename LoggerType> struct Producer {
+  using ThreadType = LogProcessingThread<LoggerType, CheckingSink>;
+
+  Producer(int index, const Options &options)
+      : mIndex(index), mSink(index, options.mSinkDelayUs),
+        mThread(MakeThread(mLogger, mSink, options)) {}
+
+  void Log() {
+    const auto start = std::chrono::steady_clock::now();
+    const auto gain = static_cast<double>(mNumLogged % 1000) * 0.001;
+    // Only this thread adds to it
+    const auto numDropped = mNumDropped.load(std::memory_order_relaxed);
+#ifdef RTLOG_USE_STB
+    const auto status = mLogger.Log(
+        {mIndex, mNumLogged, numDropped},
+        "producer %d message %" PRIu64 " gain %.3f%s", mIndex, mNumLogged,
+        gain, MessageTail(mNumLogged));
+#else
+    const auto status = mLogger.Log(
+        {mIndex, mNumLogged, numDropped},
+        FMT_STRING("producer {} message {} gain {:.3f}{}"), mIndex, mNumLogged,
+        gain, MessageTail(mNumLogged));
+#endif // RTLOG_USE_STB
+    const auto end = std::chrono::steady_clock::now();
+
+    mLatency.Add(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count()));
+    mNumLogged++;
+    if (status == Status::Error_QueueFull)
+      mNumDropped.fetch_add(1, std::memory_order_relaxed);
+    else if (status != Status::Success)
+      mNumOtherErrors++;
+  }
+
+  // Bursts of back to back messages, separated by a steady trickle. The
+  // trickle logs pairs, a short and a long message, so a SizeClassLogger gets
+  // one in each queue while its processing thread has caught up, which is
+  // when its merge can go wrong.
+  void Run(const std::atomic<bool> &running, int burstSize) {
+    while (running.load(std::memory_order_relaxed)) {
+      for (int i = 0; i < burstSize; i++)
+        Log();
+
+      if (mNumLogged % 2 != 0)
+        Log();
+      for (int i = 0; i < 100 && running.load(std::memory_order_relaxed);
+           i++) {
+        Log();
+        Log();
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    }
+  }
+
+  static ThreadType MakeThread(LoggerType &logger, CheckingSink &sink,
+                               const Options &options) {
+    const auto waitTime = std::chrono::milliseconds(options.mWaitMs);
+    if (options.mAdaptiveWait) {
+      AdaptiveWaitTime adaptiveWaitTime;
+      adaptiveWaitTime.mMaxWaitTime = waitTime;
+      return ThreadType(logger, sink, adaptiveWaitTime);
+    }
+    return ThreadType(logger, sink, waitTime);
+  }
+
+  int mIndex{};
+  LoggerType mLogger{};
+  CheckingSink mSink;
+  ThreadType mThread;
+
+  // Written by the producer thread only, read once it has joined
+  uint64_t mNumLogged{};
+  uint64_t mNumOtherErrors{};
+  LatencyHistogram mLatency{};
+  std::atomic<uint64_t> mNumDropped{0};
+};
+
+void PrintUsage() {
+  fprintf(stderr,
+          "usage: rtlog_soak [--seconds <n>] [--producers <n>] [--hogs <n>]\n"
+          "                  [--burst <n>] [--sink-delay-us <n>] "
+          "[--wait-ms <n>]\n"
+          "                  [--adaptive-wait] [--cache-aligned] "
+          "[--size-classes]\n"
+          "                  [--expect-drops]\n"
+          "\n"
+          "  --seconds        how long to run, fractions allowed\n"
+          "  --producers      loggers, each logging from its own thread\n"
+          "  --hogs           threads spinning on the CPU the whole time\n"
+          "  --burst          messages logged back to back every 10ms, by\n"
+          "                   default 4 times the queue size\n"
+          "  --sink-delay-us  how long the sink sleeps every 256 messages\n"
+          "  --wait-ms        wait time of the processing threads\n"
+          "  --adaptive-wait  adapt the wait time to the load, up to\n"
+          "                   --wait-ms\n"
+          "  --cache-aligned  queue on rtlog_SPSC_CacheAligned\n"
+          "  --size-classes   log through a SizeClassLogger with two classes\n"
+          "  --expect-drops   fail if no message was dropped, i.e. the\n"
+          "                   queue full path was never exercised\n");
+}
+
+bool ParseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; i++) {
+    const std::string name = argv[i];
+    if (name == "--adaptive-wait" || name == "--cache-aligned" ||
+        name == "--size-classes" || name == "--expect-drops") {
+      auto &flag = name == "--adaptive-wait"   ? options.mAdaptiveWait
+                   : name == "--cache-aligned" ? options.mCacheAligned
+                   : name == "--size-classes"  ? options.mSizeClasses
+                                               : options.mExpectDrops;
+      flag = true;
+      continue;
+    }
+    if (i + 1 >= argc)
+      return false;
+
+    char *end = nullptr;
+    const char *text = argv[++i];
+    const auto value = std::strtod(text, &end);
+    if (end == text || *end != '\0' || value < 0)
+      return false;
+
+    if (name == "--seconds")
+      options.mSeconds = value;
+    else if (name == "--producers")
+      options.mNumProducers = static_cast<int>(value);
+    else if (name == "--hogs")
+      options.mNumHogs = static_cast<int>(value);
+    else if (name == "--burst")
+      options.mBurstSize = static_cast<int>(value);
+    else if (name == "--sink-delay-us")
+      options.mSinkDelayUs = static_cast<int>(value);
+    else if (name == "--wait-ms")
+      options.mWaitMs = static_cast<int>(value);
+    else
+      return false;
+  }
+  return options.mNumProducers > 0;
+}
+
+void PrintHistogram(const LatencyHistogram &histogram) {
+  size_t first = LatencyHistogram::NumBuckets;
+  size_t last = 0;
+  uint64_t largest = 0;
+  for (size_t i = 0; i < LatencyHistogram::NumBuckets; i++) {
+    if (histogram.mBuckets[i] == 0)
+      continue;
+    first = std::min(first, i);
+    last = i;
+    largest = std::max(largest, histogram.mBuckets[i]);
+  }
+  if (largest == 0)
+    return;
+
+  printf("\n%-24s %12s\n", "Log latency ns", "calls");
+  for (size_t i = first; i <= last; i++) {
+    const auto count = histogram.mBuckets[i];
+    const auto width = static_cast<int>((count * 40 + largest - 1) / largest);
+    char range[48]{};
+    snprintf(range, sizeof(range), "[%" PRIu64 ", %" PRIu64 ")",
+             i == 0 ? uint64_t{0} : uint64_t{1} << i, uint64_t{2} << i);
+    printf("%-24s %12" PRIu64 " %.*s\n", range, count, width,
+           "########################################");
+  }
+
+  printf("\np50 < %" PRIu64 " ns, p99 < %" PRIu64 " ns, p99.9 < %" PRIu64
+         " ns, max %" PRIu64 " ns\n",
+         histogram.Percentile(0.5), histogram.Percentile(0.99),
+         histogram.Percentile(0.999), histogram.mMax);
+}
+
+// Runs the producers, their processing threads and the hogs for the given
+// time, then prints and checks what arrived. Returns whether it passed.
+template <typename LoggerType> bool RunSoak(const Options &options) {
+  std::vector<std::unique_ptr<Producer<LoggerType>>> producers;
+  for (int i = 0; i < options.mNumProducers; i++)
+    producers.push_back(std::make_unique<Producer<LoggerType>>(i, options));
+
+  std::atomic<bool> running{true};
+
+  std::vector<std::thread> hogs;
+  for (int i = 0; i < options.mNumHogs; i++)
+    hogs.emplace_back([&running]() {
+      volatile uint64_t spin = 0;
+      while (running.load(std::memory_order_relaxed))
+        spin = spin + 1;
+    });
+
+  std::vector<std::thread> producerThreads;
+  for (auto &producer : producers)
+    producerThreads.emplace_back([&running, &options, p = producer.get()]() {
+      p->Run(running, options.mBurstSize);
+    });
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto duration = std::chrono::duration<double>(options.mSeconds);
+  auto nextReport = start + std::chrono::seconds(10);
+  while (std::chrono::steady_clock::now() - start < duration) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (std::chrono::steady_clock::now() < nextReport)
+      continue;
+    nextReport += std::chrono::seconds(10);
+
+    size_t numProcessed = 0;
+    uint64_t numDropped = 0;
+    for (const auto &producer : producers) {
+      numProcessed += producer->mThread.GetStats().mNumProcessed;
+      numDropped += producer->mNumDropped.load(std::memory_order_relaxed);
+    }
+    printf("%6.0f s: %zu processed, %" PRIu64 " dropped\n",
+           std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+               .count(),
+           numProcessed, numDropped);
+    fflush(stdout);
+  }
+
+  running.store(false);
+  for (auto &thread : producerThreads)
+    thread.join();
+  for (auto &thread : hogs)
+    thread.join();
+
+  // Stopping does a last pass over the logger, Flush returns once the thread
+  // has exited, after which every message logged has been through the sink
+  for (auto &producer : producers) {
+    producer->mThread.Stop();
+    producer->mThread.Flush();
+  }
+
+  bool passed = true;
+  uint64_t totalLogged = 0;
+  uint64_t totalReceived = 0;
+  uint64_t totalDropped = 0;
+  LatencyHistogram latency;
+
+  printf("\n%-9s %12s %12s %12s %8s %8s\n", "producer", "logged", "received",
+         "dropped", "drop %", "errors");
+  for (const auto &producer : producers) {
+    const auto &sink = producer->mSink;
+    const auto numDropped = producer->mNumDropped.load();
+    const auto numErrors = sink.GetNumErrors() + producer->mNumOtherErrors;
+
+    // The sink saw that each gap in the indices was dropped, so this holds
+    // only if the messages after the last one received were dropped too
+    if (sink.GetNumReceived() + numDropped != producer->mNumLogged) {
+      fprintf(stderr,
+              "producer %d: %" PRIu64 " received + %" PRIu64
+              " dropped != %" PRIu64 " logged\n",
+              producer->mIndex, sink.GetNumReceived(), numDropped,
+              producer->mNumLogged);
+      passed = false;
+    }
+    if (sink.GetNumReceived() > 0 &&
+        sink.GetLastIndex() >= producer->mNumLogged) {
+      fprintf(stderr, "producer %d: received index %" PRIu64 " never logged\n",
+              producer->mIndex, sink.GetLastIndex());
+      passed = false;
+    }
+    passed = passed && numErrors == 0;
+
+    printf("%-9d %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %8.3f %8zu\n",
+           producer->mIndex, producer->mNumLogged, sink.GetNumReceived(),
+           numDropped,
+           producer->mNumLogged > 0
+               ? 100.0 * static_cast<double>(numDropped) /
+                     static_cast<double>(producer->mNumLogged)
+               : 0.0,
+           static_cast<size_t>(numErrors));
+
+    totalLogged += producer->mNumLogged;
+    totalReceived += sink.GetNumReceived();
+    totalDropped += numDropped;
+    latency.Merge(producer->mLatency);
+  }
+
+  // Every sequence number handed out is accounted for
+  if (totalReceived + totalDropped != gSequenceNumber.load()) {
+    fprintf(stderr,
+            "%" PRIu64 " received + %" PRIu64 " dropped != %zu sequence "
+            "numbers\n",
+            totalReceived, totalDropped, gSequenceNumber.load());
+    passed = false;
+  }
+
+  // Otherwise the run never got to check that drops are all reported
+  if (options.mExpectDrops && totalDropped == 0) {
+    fprintf(stderr, "no message was dropped, the queues never overflowed\n");
+    passed = false;
+  }
+
+  printf("%-9s %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %8.3f\n", "total",
+         totalLogged, totalReceived, totalDropped,
+         totalLogged > 0 ? 100.0 * static_cast<double>(totalDropped) /
+                               static_cast<double>(totalLogged)
+                         : 0.0);
+
+  PrintHistogram(latency);
+
+  return passed;
+}
+
+} // namespace rtlog::soak
+
+using namespace rtlog::soak;
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, options)) {
+    PrintUsage();
+    return 1;
+  }
+
+  printf("%d producers, %d hogs, bursts of %d, sink delay %d us, queue of %d, "
+         "%.1f s\n",
+         options.mNumProducers, options.mNumHogs, options.mBurstSize,
+         options.mSinkDelayUs, MAX_NUM_LOG_MESSAGES, options.mSeconds);
+
+  printf("%s on %s, %s wait time\n",
+         options.mSizeClasses ? "SizeClassLogger" : "Logger",
+         options.mCacheAligned ? "rtlog_SPSC_CacheAligned" : "rtlog_SPSC",
+         options.mAdaptiveWait ? "adaptive" : "fixed");
+
+  using rtlog::rtlog_SPSC;
+  using rtlog::rtlog_SPSC_CacheAligned;
+  bool passed = false;
+  if (options.mSizeClasses && options.mCacheAligned)
+    passed = RunSoak<SoakSizeClassLogger<rtlog_SPSC_CacheAligned>>(options);
+  else if (options.mSizeClasses)
+    passed = RunSoak<SoakSizeClassLogger<rtlog_SPSC>>(options);
+  else if (options.mCacheAligned)
+    passed = RunSoak<SoakLogger<rtlog_SPSC_CacheAligned>>(options);
+  else
+    passed = RunSoak<SoakLogger<rtlog_SPSC>>(options);
+
+  printf("\n%s\n", passed ? "PASSED" : "FAILED");
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+#include <rtlog/rtlog.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+// Explicit instantiations compile every non template member, as a user
+// compiling their Logger once in their own source file does (see the README)
+
+namespace rtlog::test {
+
+struct InstantiatedLogData {
+  int mLevel;
+};
+
+std::atomic<std::size_t> gInstantiatedSequenceNumber{0};
+
+using PlainLogger = rtlog::Logger<InstantiatedLogData, 128, 256,
+                                  gInstantiatedSequenceNumber>;
+using BlobLogger =
+    rtlog::Logger<InstantiatedLogData, 128, 256, gInstantiatedSequenceNumber,
+                  rtlog::rtlog_SPSC, true>;
+
+} // namespace rtlog::test
+
+template class rtlog::Logger<rtlog::test::InstantiatedLogData, 128, 256,
+                             rtlog::test::gInstantiatedSequenceNumber>;
+template class rtlog::Logger<rtlog::test::InstantiatedLogData, 128, 256,
+                             rtlog::test::gInstantiatedSequenceNumber,
+                             rtlog::rtlog_SPSC, true>;
+
+namespace rtlog::test {
+
+static_assert(!std::is_constructible_v<PlainLogger, rtlog::BlobPool &>,
+              "Only a Logger declared WithBlobs takes a BlobPool");
+static_assert(std::is_constructible_v<BlobLogger, rtlog::BlobPool &>);
+
+TEST(ExplicitInstantiationTest, InstantiatedLoggersLog) {
+  PlainLogger logger;
+#ifdef RTLOG_USE_STB
+  EXPECT_EQ(logger.Log({1}, "Hello, %d!", 123), rtlog::Status::Success);
+#else
+  EXPECT_EQ(logger.Log({1}, FMT_STRING("Hello, {}!"), 123),
+            rtlog::Status::Success);
+#endif // RTLOG_USE_STB
+
+  int numPrinted = 0;
+  EXPECT_EQ(logger.PrintAndClearLogQueue(
+                [&](const InstantiatedLogData &data, size_t, const char *,
+                    ...) {
+                  EXPECT_EQ(data.mLevel, 1);
+                  numPrinted++;
+                }),
+            1);
+  EXPECT_EQ(numPrinted, 1);
+}
+
+} // namespace rtlog::test
@@ -0,0 +1,310 @@
+#include <rtlog/indexed_file.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rtlog::test {
+
+struct IndexedLogData {
+  int mLevel;
+  int mRegion;
+};
+
+// A file in the test temp directory, removed however the test exits. Declare
+// it before the sinks and readers using it so it outlives them.
+struct TempFile {
+  explicit TempFile(const char *name) : mPath(::testing::TempDir() + name) {}
+  ~TempFile() { std::remove(mPath.c_str()); }
+
+  TempFile(const TempFile &) = delete;
+  TempFile &operator=(const TempFile &) = delete;
+
+  const std::string mPath;
+};
+
+TEST(IndexedFileTest, SequenceRangeQueriesOnlyDecodeOverlappingBlocks) {
+  const TempFile file("rtlog_sequence_range.rtlog");
+  const auto &path = file.mPath;
+
+  {
+    // Small blocks, so the 1000 records below span many of them
+    IndexedFileSink<IndexedLogData> sink(path, 1024);
+    ASSERT_TRUE(sink.IsOpen());
+    for (int i = 0; i < 1000; i++)
+      sink({i % 4, 7}, static_cast<size_t>(i), "msg %d", i);
+  }
+
+  const IndexedFileReader reader(path);
+  ASSERT_TRUE(reader.IsValid());
+  EXPECT_TRUE(reader.HasIndex());
+  ASSERT_GT(reader.GetBlocks().size(), 10u);
+
+  std::vector<IndexedFileReader::Record> records;
+  const auto numDecoded = reader.ForEachInSequenceRange(
+      500, 509, [&](const auto &record) { records.push_back(record); });
+
+  EXPECT_LE(numDecoded, 2u);
+  ASSERT_EQ(records.size(), 10u);
+  for (size_t i = 0; i < records.size(); i++) {
+    const auto expected = 500 + i;
+    EXPECT_EQ(records[i].mSequenceNumber, expected);
+    EXPECT_EQ(records[i].mMessage, "msg " + std::to_string(expected));
+
+    const auto data = records[i].GetLogData<IndexedLogData>();
+    EXPECT_EQ(data.mLevel, static_cast<int>(expected % 4));
+    EXPECT_EQ(data.mRegion, 7);
+  }
+}
+
+TEST(IndexedFileTest, TimeRangeQueriesReturnRecordsInRange) {
+  const TempFile file("rtlog_time_range.rtlog");
+  const auto &path = file.mPath;
+
+  {
+    IndexedFileSink<IndexedLogData> sink(path, 256);
+    for (int i = 0; i < 100; i++)
+      sink({0, 0}, static_cast<size_t>(i), "value %d", i);
+  }
+
+  const IndexedFileReader reader(path);
+  ASSERT_TRUE(reader.IsValid());
+
+  const auto &blocks = reader.GetBlocks();
+  ASSERT_GT(blocks.size(), 2u);
+  const auto first = blocks[1].mMinTimestamp;
+  const auto last = blocks[1].mMaxTimestamp;
+
+  size_t numRecords = 0;
+  reader.ForEachInTimeRange(first, last, [&](const auto &record) {
+    EXPECT_GE(record.mTimestamp, first);
+    EXPECT_LE(record.mTimestamp, last);
+    numRecords++;
+  });
+  EXPECT_GT(numRecords, 0u);
+
+  size_t numAll = 0;
+  reader.ForEachInTimeRange(blocks.front().mMinTimestamp,
+                            blocks.back().mMaxTimestamp,
+                            [&](const auto &) { numAll++; });
+  EXPECT_EQ(numAll, 100u);
+}
+
+TEST(IndexedFileTest, FileWithoutIndexIsStillReadable) {
+  const TempFile file("rtlog_no_index.rtlog");
+  const auto &path = file.mPath;
+
+  IndexedFileSink<IndexedLogData> sink(path, 256);
+  for (int i = 0; i < 50; i++)
+    sink({0, 0}, static_cast<size_t>(i), "value %d", i);
+
+  // Flushed but never closed, as if the process had crashed
+  sink.Flush();
+
+  const IndexedFileReader reader(path);
+  ASSERT_TRUE(reader.IsValid());
+  EXPECT_FALSE(reader.HasIndex());
+
+  std::vector<std::string> messages;
+  reader.ForEachInSequenceRange(40, 100, [&](const auto &record) {
+    messages.emplace_back(record.mMessage);
+  });
+
+  ASSERT_EQ(messages.size(), 10u);
+  EXPECT_EQ(messages.front(), "value 40");
+  EXPECT_EQ(messages.back(), "value 49");
+}
+
+TEST(IndexedFileTest, OldPartialBlocksAreWrittenWithoutFlush) {
+  const TempFile file("rtlog_block_age.rtlog");
+  const auto &path = file.mPath;
+
+  // Read while the sink is still open, as after a crash
+  auto countRecords = [&path]() {
+    size_t numRecords = 0;
+    IndexedFileReader(path).ForEachInSequenceRange(
+        0, 100, [&](const auto &) { numRecords++; });
+    return numRecords;
+  };
+
+  IndexedFileSink<IndexedLogData> sink(
+      path, IndexedFileSink<IndexedLogData>::DefaultBlockSize,
+      IndexedFileCompression::None, std::chrono::milliseconds(20));
+
+  sink({0, 0}, 0, "first");
+  EXPECT_EQ(countRecords(), 0u);
+
+  // The block is now older than its maximum age, the next record writes it
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  sink({0, 0}, 1, "second");
+  EXPECT_EQ(countRecords(), 2u);
+
+  // A fresh block, still in memory
+  sink({0, 0}, 2, "third");
+  EXPECT_EQ(countRecords(), 2u);
+}
+
+TEST(IndexedFileTest, FooterWithOverflowingBlockCountIsIgnored) {
+  const TempFile file("rtlog_bad_footer.rtlog");
+  const auto &path = file.mPath;
+
+  {
+    IndexedFileSink<IndexedLogData> sink(path, 256);
+    for (int i = 0; i < 50; i++)
+      sink({0, 0}, static_cast<size_t>(i), "value %d", i);
+  }
+
+  uint64_t numBlocks = 0;
+  {
+    const IndexedFileReader reader(path);
+    ASSERT_TRUE(reader.HasIndex());
+    numBlocks = reader.GetBlocks().size();
+  }
+
+  // sizeof(IndexedFileBlock) is a multiple of 8, so adding 2^61 blocks wraps
+  // the index size back around to the real one
+  static_assert(sizeof(IndexedFileBlock) % 8 == 0);
+  {
+    std::fstream stream(path,
+                        std::ios::in | std::ios::out | std::ios::binary);
+    stream.seekp(-static_cast<std::streamoff>(
+                     sizeof(detail::IndexedFileFooter) -
+                     offsetof(detail::IndexedFileFooter, mNumBlocks)),
+                 std::ios::end);
+    numBlocks += uint64_t{1} << 61;
+    stream.write(reinterpret_cast<const char *>(&numBlocks),
+                 sizeof(numBlocks));
+  }
+
+  const IndexedFileReader reader(path);
+  ASSERT_TRUE(reader.IsValid());
+  EXPECT_FALSE(reader.HasIndex());
+
+  size_t numRecords = 0;
+  reader.ForEachInSequenceRange(0, 49, [&](const auto &) { numRecords++; });
+  EXPECT_EQ(numRecords, 50u);
+}
+
+TEST(IndexedFileTest, LzCompressionRoundTrips) {
+  uint32_t state = 1;
+  auto next = [&state]() {
+    state = state * 1664525u + 1013904223u;
+    return static_cast<char>(state >> 24);
+  };
+
+  std::string random(5000, '\0');
+  for (auto &c : random)
+    c = next();
+
+  std::string text;
+  for (int i = 0; i < 500; i++)
+    text += "[INFO] voice " + std::to_string(i % 16) + " started\n";
+
+  const std::vector<std::string> inputs{
+      "", "abc", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", random, text,
+      std::string(100000, 'x') + random};
+
+  // One table for all inputs, as a sink reuses it from block to block
+  std::vector<uint32_t> table;
+  for (const auto &input : inputs) {
+    std::vector<char> compressed;
+    detail::LzCompress(input.data(), input.size(), table, compressed);
+
+    std::string output(input.size(), '\0');
+    EXPECT_TRUE(detail::LzDecompress(
+        reinterpret_cast<const std::byte *>(compressed.data()),
+        compressed.size(), output.data(), output.size()));
+    EXPECT_EQ(output, input);
+  }
+
+  std::vector<char> compressed;
+  detail::LzCompress(text.data(), text.size(), table, compressed);
+  EXPECT_LT(compressed.size() * 5, text.size());
+
+  // Damaged input is rejected rather than read out of bounds
+  std::string output(text.size(), '\0');
+  compressed.resize(compressed.size() / 2);
+  EXPECT_FALSE(detail::LzDecompress(
+      reinterpret_cast<const std::byte *>(compressed.data()),
+      compressed.size(), output.data(), output.size()));
+}
+
+TEST(IndexedFileTest, CompressedFilesReadTheSame) {
+  const TempFile plainFile("rtlog_plain.rtlog");
+  const auto &plainPath = plainFile.mPath;
+  const TempFile compressedFile("rtlog_compressed.rtlog");
+  const auto &compressedPath = compressedFile.mPath;
+  const TempFile decompressedFile("rtlog_decompressed.rtlog");
+  const auto &decompressedPath = decompressedFile.mPath;
+
+  {
+    IndexedFileSink<IndexedLogData> plain(plainPath, 32 * 1024);
+    IndexedFileSink<IndexedLogData> compressed(compressedPath, 32 * 1024,
+                                               IndexedFileCompression::Lz);
+    for (int i = 0; i < 2000; i++) {
+      plain({i % 4, 1}, static_cast<size_t>(i),
+            "[INFO] audio: voice %d started, gain %d dB", i % 16, i % 7);
+      compressed({i % 4, 1}, static_cast<size_t>(i),
+                 "[INFO] audio: voice %d started, gain %d dB", i % 16, i % 7);
+    }
+  }
+
+  const IndexedFileReader compressed(compressedPath);
+  ASSERT_TRUE(compressed.IsValid());
+  // Writing over the input would truncate it while it is being read
+  EXPECT_FALSE(compressed.WriteDecompressed(compressedPath));
+  ASSERT_TRUE(compressed.WriteDecompressed(decompressedPath));
+
+  const IndexedFileReader plain(plainPath);
+  const IndexedFileReader decompressed(decompressedPath);
+  ASSERT_TRUE(plain.IsValid());
+  ASSERT_TRUE(decompressed.IsValid());
+
+  auto readAll = [](const IndexedFileReader &reader) {
+    std::vector<std::string> messages;
+    reader.ForEachInSequenceRange(0, 1999, [&](const auto &record) {
+      messages.push_back(std::to_string(record.mSequenceNumber) + " " +
+                         std::string(record.mMessage));
+    });
+    return messages;
+  };
+
+  const auto expected = readAll(plain);
+  EXPECT_EQ(expected.size(), 2000u);
+  EXPECT_EQ(readAll(compressed), expected);
+  EXPECT_EQ(readAll(decompressed), expected);
+
+  // A range still only decompresses the blocks it overlaps
+  size_t numRecords = 0;
+  const auto numDecoded = compressed.ForEachInSequenceRange(
+      1000, 1009, [&](const auto &) { numRecords++; });
+  EXPECT_EQ(numRecords, 10u);
+  EXPECT_LE(numDecoded, 2u);
+
+  EXPECT_LT(detail::MappedFile(compressedPath).size() * 4,
+            detail::MappedFile(plainPath).size());
+}
+
+TEST(IndexedFileTest, OtherFilesAreRejected) {
+  const TempFile missing("rtlog_missing.rtlog");
+  EXPECT_FALSE(IndexedFileReader(missing.mPath).IsValid());
+
+  // A version this reader does not know about
+  const TempFile newer("rtlog_newer.rtlog");
+  {
+    detail::IndexedFileHeader header;
+    header.mVersion = detail::IndexedFileVersion + 1;
+    header.mLogDataSize = sizeof(IndexedLogData);
+    std::ofstream stream(newer.mPath, std::ios::binary);
+    stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  }
+  EXPECT_FALSE(IndexedFileReader(newer.mPath).IsValid());
+}
+
+} // namespace rtlog::test
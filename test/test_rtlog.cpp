@@ -2,9 +2,26 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#endif // __linux__
+
 namespace rtlog::test {
 
 static std::atomic<std::size_t> gSequenceNumber{0};
+static rtlog::PaddedSequenceNumber gPaddedSequenceNumber{0};
 
 constexpr auto MAX_LOG_MESSAGE_LENGTH = 256;
 constexpr auto MAX_NUM_LOG_MESSAGES = 100;
@@ -195,6 +212,341 @@ TEST(RtlogTest, ErrorsReturnedFromLog) {
   };
   EXPECT_EQ(truncatedLogger.PrintAndClearLogQueue(InspectLogMessage), 1);
 }
+
+TEST(RtlogTest, CacheAlignedQueueWorks) {
+  using InternalLogData =
+      rtlog::detail::BasicLogData<ExampleLogData, MAX_LOG_MESSAGE_LENGTH>;
+  static_assert(sizeof(rtlog::detail::CacheLinePadded<InternalLogData>) %
+                    rtlog::CacheLineSize ==
+                0);
+
+  rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
+                gPaddedSequenceNumber, rtlog::rtlog_SPSC_CacheAligned>
+      logger;
+
+  EXPECT_EQ(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+                       "Hello, %d!", 123),
+            rtlog::Status::Success);
+  EXPECT_EQ(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Game},
+                       "Hello, %s!", "world"),
+            rtlog::Status::Success);
+
+  EXPECT_EQ(logger.PrintAndClearLogQueue(PrintMessage), 2);
+  EXPECT_EQ(gPaddedSequenceNumber.load(), 2u);
+}
+
+TEST(RtlogTest, SizeClassLoggerRoutesAndMerges) {
+  rtlog::SizeClassLogger<ExampleLogData, gSequenceNumber,
+                         rtlog::SizeClass<MAX_NUM_LOG_MESSAGES, 16>,
+                         rtlog::SizeClass<4, 64>>
+      logger;
+
+  const std::string longMessage(40, 'x');
+  const std::string tooLongMessage(100, 'y');
+
+  EXPECT_EQ(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+                       "short %d", 1),
+            rtlog::Status::Success);
+  EXPECT_EQ(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Game}, "%s",
+                       longMessage.c_str()),
+            rtlog::Status::Success);
+  EXPECT_EQ(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+                       "short %d", 2),
+            rtlog::Status::Success);
+  EXPECT_EQ(logger.Log({ExampleLogLevel::Critical, ExampleLogRegion::Audio},
+                       "%s", tooLongMessage.c_str()),
+            rtlog::Status::Error_MessageTruncated);
+
+  std::vector<std::string> messages;
+  size_t lastSequenceNumber = 0;
+  auto InspectLogMessage = [&](const ExampleLogData &, size_t sequenceNumber,
+                               const char *fstring, ...) {
+    if (!messages.empty()) {
+      EXPECT_GT(sequenceNumber, lastSequenceNumber);
+    }
+    lastSequenceNumber = sequenceNumber;
+
+    std::array<char, MAX_LOG_MESSAGE_LENGTH> buffer{};
+    va_list args;
+    va_start(args, fstring);
+    vsnprintf(buffer.data(), buffer.size(), fstring, args);
+    va_end(args);
+    messages.emplace_back(buffer.data());
+  };
+
+  EXPECT_EQ(logger.PrintAndClearLogQueue(InspectLogMessage), 4);
+  ASSERT_EQ(messages.size(), 4u);
+  EXPECT_EQ(messages[0], "short 1");
+  EXPECT_EQ(messages[1], longMessage);
+  EXPECT_EQ(messages[2], "short 2");
+  EXPECT_EQ(messages[3], tooLongMessage.substr(0, 63));
+}
+
+// One producer alternating between size classes while another thread
+// drains, as with a LogProcessingThread
+TEST(RtlogTest, SizeClassLoggerMergesInOrderWhileLogging) {
+  rtlog::SizeClassLogger<ExampleLogData, gSequenceNumber,
+                         rtlog::SizeClass<MAX_NUM_LOG_MESSAGES, 16>,
+                         rtlog::SizeClass<MAX_NUM_LOG_MESSAGES, 64>>
+      logger;
+
+  std::atomic<bool> isDone{false};
+  std::thread producer([&]() {
+    const std::string longMessage(40, 'x');
+    for (int i = 0; i < 1000000; i++) {
+      if (i % 2 == 0)
+        logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+                   "short %d", i);
+      else
+        logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Game}, "%s",
+                   longMessage.c_str());
+    }
+    isDone = true;
+  });
+
+  std::optional<size_t> lastSequenceNumber;
+  size_t numOutOfOrder = 0;
+  auto CheckOrder = [&](const ExampleLogData &, size_t sequenceNumber,
+                        const char *, ...) {
+    if (lastSequenceNumber.has_value() &&
+        sequenceNumber <= *lastSequenceNumber)
+      numOutOfOrder++;
+    lastSequenceNumber = sequenceNumber;
+  };
+
+  while (!isDone)
+    logger.PrintAndClearLogQueue(CheckOrder);
+  producer.join();
+  logger.PrintAndClearLogQueue(CheckOrder);
+
+  EXPECT_EQ(numOutOfOrder, 0u);
+}
+
+TEST(RtlogTest, BlobsAreAttachedAndReturnedToThePool) {
+  // Loggers without blobs do not pay for the handle
+  static_assert(
+      sizeof(rtlog::detail::BasicLogData<ExampleLogData, 64>) <
+      sizeof(rtlog::detail::BasicLogData<ExampleLogData, 64, true>));
+
+  rtlog::BlobPool pool{1, 4};
+  rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
+                gSequenceNumber, rtlog::rtlog_SPSC, true>
+      logger{pool};
+
+  const std::array<uint8_t, 4> midiPacket{0x90, 0x3c, 0x7f, 0x00};
+  EXPECT_EQ(
+      logger.LogWithBlob({ExampleLogLevel::Debug, ExampleLogRegion::Audio},
+                         midiPacket.data(), midiPacket.size(), "note on %d",
+                         60),
+      rtlog::Status::Success);
+  EXPECT_EQ(
+      logger.LogWithBlob({ExampleLogLevel::Debug, ExampleLogRegion::Audio},
+                         midiPacket.data(), midiPacket.size(),
+                         "pool is exhausted"),
+      rtlog::Status::Error_BlobDropped);
+
+  std::vector<std::vector<uint8_t>> blobs;
+  auto InspectBlob = [&](const ExampleLogData &, size_t, rtlog::BlobView blob,
+                         const char *, ...) {
+    const auto *bytes = reinterpret_cast<const uint8_t *>(blob.mData);
+    blobs.emplace_back(bytes, bytes + blob.mSize);
+  };
+
+  EXPECT_EQ(logger.PrintAndClearLogQueue(InspectBlob), 2);
+  ASSERT_EQ(blobs.size(), 2u);
+  EXPECT_EQ(blobs[0],
+            std::vector<uint8_t>(midiPacket.begin(), midiPacket.end()));
+  EXPECT_TRUE(blobs[1].empty());
+
+  // The block went back to the pool, even for a PrintLogFn that ignores blobs
+  const std::array<uint8_t, 6> tooLarge{};
+  EXPECT_EQ(
+      logger.LogWithBlob({ExampleLogLevel::Debug, ExampleLogRegion::Audio},
+                         tooLarge.data(), tooLarge.size(), "truncated"),
+      rtlog::Status::Error_BlobTruncated);
+  EXPECT_EQ(logger.PrintAndClearLogQueue(PrintMessage), 1);
+  EXPECT_EQ(
+      logger.LogWithBlob({ExampleLogLevel::Debug, ExampleLogRegion::Audio},
+                         midiPacket.data(), midiPacket.size(), "again"),
+      rtlog::Status::Success);
+}
+
+TEST(RtlogTest, AdaptiveLoggerThreadDrainsThenBacksOffWhenIdle) {
+  rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
+                gSequenceNumber>
+      logger;
+
+  const rtlog::AdaptiveWaitTime waitTime{std::chrono::microseconds(100),
+                                         std::chrono::milliseconds(5), 0.5};
+  rtlog::LogProcessingThread thread(logger, PrintMessage, waitTime);
+
+  const size_t numMessages = 20;
+  for (size_t i = 0; i < numMessages; i++)
+    logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+               "Hello, %zu!", i);
+
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (thread.GetStats().mNumProcessed < numMessages &&
+         std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_EQ(thread.GetStats().mNumProcessed, numMessages);
+
+  // Nothing else arrives, so the wait keeps doubling up to the maximum
+  while (thread.GetStats().mCurrentWaitTime < waitTime.mMaxWaitTime &&
+         std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_EQ(thread.GetStats().mCurrentWaitTime, waitTime.mMaxWaitTime);
+
+  thread.Stop();
+}
+
+TEST(RtlogTest, AdaptiveLoggerThreadPutsInvalidBoundsInOrder) {
+  using std::chrono::microseconds;
+
+  rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
+                gSequenceNumber>
+      logger;
+
+  // The maximum below the minimum, and a ratio that would spin after every
+  // message. The maximum is raised to the minimum and the ratio replaced, so
+  // the wait can only ever be the minimum.
+  const rtlog::AdaptiveWaitTime waitTime{microseconds(2000),
+                                         microseconds(100), 0.0};
+  rtlog::LogProcessingThread thread(logger, PrintMessage, waitTime);
+
+  for (int i = 0; i < 20; i++) {
+    logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+               "Hello, %d!", i);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(thread.GetStats().mCurrentWaitTime, waitTime.mMinWaitTime);
+  }
+
+  thread.Stop();
+}
+
+static int FastFormat(char *buffer, size_t size, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  const auto result =
+      rtlog::detail::FastFormatMessage(buffer, size, format, args);
+  va_end(args);
+  return result;
+}
+
+struct Formatted {
+  int mLength{};
+  std::string mText{};
+};
+
+static bool operator==(const Formatted &lhs, const Formatted &rhs) {
+  return lhs.mLength == rhs.mLength && lhs.mText == rhs.mText;
+}
+
+template <typename... Args>
+static Formatted FormatFast(size_t size, const char *format, Args... args) {
+  std::array<char, 128> buffer{};
+  const auto length = FastFormat(buffer.data(), size, format, args...);
+  return {length, buffer.data()};
+}
+
+template <typename... Args>
+static Formatted FormatWithPrintf(size_t size, const char *format,
+                                  Args... args) {
+  std::array<char, 128> buffer{};
+  const auto length = std::snprintf(buffer.data(), size, format, args...);
+  return {length, buffer.data()};
+}
+
+template <typename... Args>
+static Formatted FormatWithStb(size_t size, const char *format, Args... args) {
+  std::array<char, 128> buffer{};
+  const auto length =
+      stbsp_snprintf(buffer.data(), static_cast<int>(size), format, args...);
+  return {length, buffer.data()};
+}
+
+static void ExpectSameFormat(const Formatted &actual,
+                             const Formatted &expected, const char *format) {
+  EXPECT_EQ(actual.mLength, expected.mLength) << format;
+  EXPECT_EQ(actual.mText, expected.mText) << format;
+}
+
+// For what the fast path formats itself, floats included, as it rounds
+// exactly like printf
+template <typename... Args>
+static void ExpectSameAsPrintf(size_t size, const char *format,
+                               Args... args) {
+  ExpectSameFormat(FormatFast(size, format, args...),
+                   FormatWithPrintf(size, format, args...), format);
+}
+
+// For what falls back to stb_sprintf, whose floats may differ from printf in
+// the last digit
+template <typename... Args>
+static void ExpectSameAsStb(size_t size, const char *format, Args... args) {
+  ExpectSameFormat(FormatFast(size, format, args...),
+                   FormatWithStb(size, format, args...), format);
+}
+
+TEST(RtlogTest, FastFormatMatchesPrintf) {
+  ExpectSameAsPrintf(128, "value %d gain %f", 42, 0.5);
+  ExpectSameAsPrintf(128, "[%5d] [%-5d] [%05d] [%+d] [% d] [%.3d] [%.0d]", 42,
+                     -42, -42, 42, 42, 7, 0);
+  ExpectSameAsPrintf(128, "%i %d %d", std::numeric_limits<int>::min(),
+                     std::numeric_limits<int>::max(), 0);
+  ExpectSameAsPrintf(128, "%u %x %X %08x %.0x", 4000000000u, 0xbeefu,
+                     0xbeefu, 0xabu, 0u);
+  ExpectSameAsPrintf(128, "%hhd %hd %ld %lld %zu %zd", 300, 70000, -5l,
+                     std::numeric_limits<long long>::min(), size_t{123},
+                     std::make_signed_t<size_t>{-3});
+  ExpectSameAsPrintf(128, "%*d|%-*d|%.*f", 6, 1, 6, 2, 2, 3.14159);
+  ExpectSameAsPrintf(128, "%f %.2f %.0f %10.4f %012.3f %+f % .1f", 1.0 / 3,
+                     -2.345678, 0.4, 440.0, -1.5, 0.0, -0.0);
+  ExpectSameAsPrintf(128, "%g %g %g %.3g %g %g %g", 0.0, 100000.0, 1e-4,
+                     2.0 / 3, 9.9999996, 123.456, -0.001234);
+  ExpectSameAsPrintf(128, "[%s] [%8s] [%-8s] [%.3s] [%c] [%%]", "hi", "hi",
+                     "hi", "hello", 'x');
+
+  // Too close to a rounding boundary, or not handled, falls back
+  ExpectSameAsStb(128, "%.2f %.0f %.1f", 2.675, 2.5, 0.25);
+  ExpectSameAsStb(128, "%e %g %g %.12f %o", 1.5, 1e-5, 1e10, 0.1, 8);
+
+  // Truncated like snprintf
+  for (const size_t size : {0, 1, 5, 12})
+    ExpectSameAsPrintf(size, "hello %d world %.2f", 12345, 1.5);
+}
+
+TEST(RtlogTest, FastFormatMatchesPrintfForManyValues) {
+  uint64_t state = 12345;
+  auto next = [&state]() {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return static_cast<int64_t>(state >> 33);
+  };
+
+  for (int i = 0; i < 10000; i++) {
+    const auto value = static_cast<double>(next() % 2000001 - 1000000) /
+                       997.0 * std::pow(10.0, static_cast<int>(next() % 9) - 4);
+
+    // Whether the message was formatted by the fast path or handed over to
+    // stb_sprintf depends on the value, only the latter may differ from
+    // printf
+    const auto *floatFormat = "%f %.3f %.0f %g %.4g";
+    const auto actual =
+        FormatFast(128, floatFormat, value, value, value, value, value);
+    const auto printed =
+        FormatWithPrintf(128, floatFormat, value, value, value, value, value);
+    if (!(actual == printed))
+      ExpectSameFormat(actual,
+                       FormatWithStb(128, floatFormat, value, value, value,
+                                     value, value),
+                       floatFormat);
+
+    const auto integer = static_cast<int>(next());
+    ExpectSameAsPrintf(128, "%d %u %x %7d", integer, integer, integer,
+                       integer % 1000);
+  }
+}
 #endif // RTLOG_USE_STB
 
 #ifdef RTLOG_USE_FMTLIB
@@ -276,4 +628,382 @@ TEST(LoggerTest, LogHandlesQueueFullError) {
   EXPECT_EQ(status, rtlog::Status::Error_QueueFull);
 }
 
+TEST(LoggerTest, CacheAlignedQueueWorks) {
+  rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
+                gPaddedSequenceNumber, rtlog::rtlog_SPSC_CacheAligned>
+      logger;
+
+  EXPECT_EQ(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+                       FMT_STRING("Hello, {}!"), 123),
+            rtlog::Status::Success);
+
+  EXPECT_EQ(logger.PrintAndClearLogQueue(PrintMessage), 1);
+  EXPECT_EQ(gPaddedSequenceNumber.load(), 1u);
+}
+
+TEST(LoggerTest, SizeClassLoggerRoutesAndMerges) {
+  rtlog::SizeClassLogger<ExampleLogData, gSequenceNumber,
+                         rtlog::SizeClass<MAX_NUM_LOG_MESSAGES, 16>,
+                         rtlog::SizeClass<4, 64>>
+      logger;
+
+  const std::string longMessage(40, 'x');
+
+  EXPECT_EQ(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+                       FMT_STRING("short {}"), 1),
+            rtlog::Status::Success);
+  EXPECT_EQ(logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Game},
+                       FMT_STRING("{}"), longMessage),
+            rtlog::Status::Success);
+  EXPECT_EQ(logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+                       FMT_STRING("short {}"), 2),
+            rtlog::Status::Success);
+
+  std::vector<std::string> messages;
+  auto InspectLogMessage = [&](const ExampleLogData &, size_t,
+                               const char *fstring, ...) {
+    std::array<char, MAX_LOG_MESSAGE_LENGTH> buffer{};
+    va_list args;
+    va_start(args, fstring);
+    vsnprintf(buffer.data(), buffer.size(), fstring, args);
+    va_end(args);
+    messages.emplace_back(buffer.data());
+  };
+
+  EXPECT_EQ(logger.PrintAndClearLogQueue(InspectLogMessage), 3);
+  ASSERT_EQ(messages.size(), 3u);
+  EXPECT_EQ(messages[0], "short 1");
+  EXPECT_EQ(messages[1], longMessage);
+  EXPECT_EQ(messages[2], "short 2");
+}
+
+// One producer alternating between size classes while another thread
+// drains, as with a LogProcessingThread
+TEST(LoggerTest, SizeClassLoggerMergesInOrderWhileLogging) {
+  rtlog::SizeClassLogger<ExampleLogData, gSequenceNumber,
+                         rtlog::SizeClass<MAX_NUM_LOG_MESSAGES, 16>,
+                         rtlog::SizeClass<MAX_NUM_LOG_MESSAGES, 64>>
+      logger;
+
+  std::atomic<bool> isDone{false};
+  std::thread producer([&]() {
+    const std::string longMessage(40, 'x');
+    for (int i = 0; i < 1000000; i++) {
+      if (i % 2 == 0)
+        logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+                   FMT_STRING("short {}"), i);
+      else
+        logger.Log({ExampleLogLevel::Info, ExampleLogRegion::Game},
+                   FMT_STRING("{}"), longMessage);
+    }
+    isDone = true;
+  });
+
+  std::optional<size_t> lastSequenceNumber;
+  size_t numOutOfOrder = 0;
+  auto CheckOrder = [&](const ExampleLogData &, size_t sequenceNumber,
+                        const char *, ...) {
+    if (lastSequenceNumber.has_value() &&
+        sequenceNumber <= *lastSequenceNumber)
+      numOutOfOrder++;
+    lastSequenceNumber = sequenceNumber;
+  };
+
+  while (!isDone)
+    logger.PrintAndClearLogQueue(CheckOrder);
+  producer.join();
+  logger.PrintAndClearLogQueue(CheckOrder);
+
+  EXPECT_EQ(numOutOfOrder, 0u);
+}
+
+TEST(LoggerTest, BlobsAreAttachedAndReturnedToThePool) {
+  rtlog::BlobPool pool{1, 4};
+  rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
+                gSequenceNumber, rtlog::rtlog_SPSC, true>
+      logger{pool};
+
+  const std::array<uint8_t, 4> midiPacket{0x90, 0x3c, 0x7f, 0x00};
+  EXPECT_EQ(
+      logger.LogWithBlob({ExampleLogLevel::Debug, ExampleLogRegion::Audio},
+                         midiPacket.data(), midiPacket.size(),
+                         FMT_STRING("note on {}"), 60),
+      rtlog::Status::Success);
+
+  std::vector<uint8_t> received;
+  auto InspectBlob = [&](const ExampleLogData &, size_t, rtlog::BlobView blob,
+                         const char *, ...) {
+    const auto *bytes = reinterpret_cast<const uint8_t *>(blob.mData);
+    received.assign(bytes, bytes + blob.mSize);
+  };
+
+  EXPECT_EQ(logger.PrintAndClearLogQueue(InspectBlob), 1);
+  EXPECT_EQ(received,
+            std::vector<uint8_t>(midiPacket.begin(), midiPacket.end()));
+  EXPECT_EQ(
+      logger.LogWithBlob({ExampleLogLevel::Debug, ExampleLogRegion::Audio},
+                         midiPacket.data(), midiPacket.size(),
+                         FMT_STRING("again")),
+      rtlog::Status::Success);
+}
+
 #endif // RTLOG_USE_FMTLIB
+
+TEST(SinkQueueTest, FilterDecidesWhatIsBuffered) {
+  auto onlyAudio = [](const ExampleLogData &data) {
+    return data.region == ExampleLogRegion::Audio;
+  };
+  rtlog::SinkQueue<ExampleLogData, MAX_NUM_LOG_MESSAGES,
+                   MAX_LOG_MESSAGE_LENGTH, decltype(onlyAudio)>
+      sink{onlyAudio};
+
+  sink({ExampleLogLevel::Debug, ExampleLogRegion::Engine}, 1, "%s", "engine");
+  sink({ExampleLogLevel::Debug, ExampleLogRegion::Audio}, 2, "%s", "audio");
+
+  auto InspectLogMessage = [](const ExampleLogData &data,
+                              size_t sequenceNumber, const char *fstring,
+                              ...) {
+    EXPECT_EQ(data.region, ExampleLogRegion::Audio);
+    EXPECT_EQ(sequenceNumber, 2u);
+
+    std::array<char, MAX_LOG_MESSAGE_LENGTH> buffer{};
+    va_list args;
+    va_start(args, fstring);
+    vsnprintf(buffer.data(), buffer.size(), fstring, args);
+    va_end(args);
+
+    EXPECT_STREQ(buffer.data(), "audio");
+  };
+
+  EXPECT_EQ(sink.PrintAndClearLogQueue(InspectLogMessage), 1);
+}
+
+TEST(SinkQueueTest, StalledSinkDoesNotBlockOtherSinks) {
+  const auto stalledSinkSize = 2;
+  rtlog::SinkQueue<ExampleLogData, MAX_NUM_LOG_MESSAGES,
+                   MAX_LOG_MESSAGE_LENGTH>
+      fastSink;
+  rtlog::SinkQueue<ExampleLogData, stalledSinkSize, MAX_LOG_MESSAGE_LENGTH>
+      stalledSink;
+  rtlog::FanOut fanOut(fastSink, stalledSink);
+
+  const auto numMessages = 10;
+  for (size_t i = 0; i < numMessages; i++)
+    fanOut(ExampleLogData{ExampleLogLevel::Info, ExampleLogRegion::Game}, i,
+           "Hello, %zu!", i);
+
+  size_t expectedSequenceNumber = 0;
+  auto InspectOrder = [&](const ExampleLogData &, size_t sequenceNumber,
+                          const char *, ...) {
+    EXPECT_EQ(sequenceNumber, expectedSequenceNumber++);
+  };
+
+  EXPECT_EQ(fastSink.PrintAndClearLogQueue(InspectOrder), numMessages);
+  EXPECT_EQ(fastSink.GetNumDropped(), 0u);
+  EXPECT_EQ(stalledSink.GetNumDropped(), numMessages - stalledSinkSize);
+  EXPECT_EQ(stalledSink.PrintAndClearLogQueue(PrintMessage), stalledSinkSize);
+}
+
+TEST(LogProcessingThreadTest,
+     AdaptiveWaitGrowsWhenIdleShrinksUnderLoadAndSpinsNearCapacity) {
+  using std::chrono::microseconds;
+  using rtlog::detail::NextAdaptiveWaitTime;
+
+  const rtlog::AdaptiveWaitTime bounds{microseconds(100), microseconds(50000),
+                                       0.5};
+  const size_t capacity = 100;
+
+  // Idle: doubles every pass until it reaches the maximum, and stays there
+  auto wait = bounds.mMinWaitTime;
+  for (int i = 0; i < 12; i++) {
+    const auto next = NextAdaptiveWaitTime(bounds, wait, 0, capacity, 0.01);
+    EXPECT_TRUE(next == wait * 2 || next == bounds.mMaxWaitTime);
+    wait = next;
+  }
+  EXPECT_EQ(wait, bounds.mMaxWaitTime);
+
+  // Under load: long enough for a quarter of the queue to fill at the rate
+  // the last pass saw, 20 messages in 5ms -> 25 messages in 6.25ms
+  const auto loaded =
+      NextAdaptiveWaitTime(bounds, bounds.mMaxWaitTime, 20, capacity, 0.005);
+  EXPECT_NEAR(static_cast<double>(loaded.count()), 6250.0, 1.0);
+
+  // Heavier load, shorter wait, but never below the minimum
+  const auto heavier =
+      NextAdaptiveWaitTime(bounds, bounds.mMaxWaitTime, 40, capacity, 0.001);
+  EXPECT_LT(heavier, loaded);
+  EXPECT_GE(heavier, bounds.mMinWaitTime);
+  EXPECT_EQ(
+      NextAdaptiveWaitTime(bounds, bounds.mMaxWaitTime, 49, capacity, 1e-5),
+      bounds.mMinWaitTime);
+
+  // Near capacity: spin, then back to the minimum once a pass finds nothing
+  EXPECT_EQ(NextAdaptiveWaitTime(bounds, loaded, 50, capacity, 0.005),
+            microseconds::zero());
+  EXPECT_EQ(NextAdaptiveWaitTime(bounds, loaded, 100, capacity, 0.005),
+            microseconds::zero());
+  EXPECT_EQ(NextAdaptiveWaitTime(bounds, microseconds::zero(), 0, capacity,
+                                 0.001),
+            bounds.mMinWaitTime);
+
+  // Without a known capacity it halves under load and never spins
+  EXPECT_EQ(NextAdaptiveWaitTime(bounds, microseconds(8000), 100, 0, 0.001),
+            microseconds(4000));
+  EXPECT_EQ(NextAdaptiveWaitTime(bounds, bounds.mMinWaitTime, 100, 0, 0.001),
+            bounds.mMinWaitTime);
+}
+
+TEST(LogProcessingThreadTest, FlushWaitsForEverythingEnqueuedBefore) {
+  rtlog::SinkQueue<ExampleLogData, MAX_NUM_LOG_MESSAGES,
+                   MAX_LOG_MESSAGE_LENGTH>
+      queue;
+
+  std::atomic<size_t> numPrinted{0};
+  auto CountMessage = [&](const ExampleLogData &, size_t, const char *, ...) {
+    numPrinted++;
+  };
+
+  // Long enough that only Flush and Stop can explain a timely wake up
+  const auto waitTime = std::chrono::seconds(10);
+  const auto start = std::chrono::steady_clock::now();
+  {
+    rtlog::LogProcessingThread thread(queue, CountMessage, waitTime);
+    EXPECT_FALSE(thread.Flush().has_value());
+
+    const size_t numMessages = 20;
+    for (size_t i = 0; i < numMessages; i++)
+      queue({ExampleLogLevel::Info, ExampleLogRegion::Game}, 100 + i,
+            "Hello, %zu!", i);
+
+    const auto flushed = thread.Flush();
+    ASSERT_TRUE(flushed.has_value());
+    EXPECT_EQ(*flushed, 100 + numMessages - 1);
+    EXPECT_EQ(numPrinted.load(), numMessages);
+
+    thread.Stop();
+  }
+
+  EXPECT_LT(std::chrono::steady_clock::now() - start, waitTime);
+}
+
+TEST(LogProcessingThreadTest, FlushWithTimeoutGivesUpOnAStuckPrintFn) {
+  rtlog::SinkQueue<ExampleLogData, MAX_NUM_LOG_MESSAGES,
+                   MAX_LOG_MESSAGE_LENGTH>
+      queue;
+
+  // A sink stuck on I/O until told otherwise
+  std::atomic<bool> isStuck{true};
+  auto StuckMessage = [&](const ExampleLogData &, size_t, const char *, ...) {
+    while (isStuck)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  };
+
+  rtlog::LogProcessingThread thread(queue, StuckMessage,
+                                    std::chrono::milliseconds(1));
+  queue({ExampleLogLevel::Info, ExampleLogRegion::Game}, 7, "Hello, %d!", 7);
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto stuck = thread.Flush(std::chrono::milliseconds(50));
+  EXPECT_FALSE(stuck.mCompleted);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+
+  isStuck = false;
+  const auto flushed = thread.Flush(std::chrono::seconds(10));
+  EXPECT_TRUE(flushed.mCompleted);
+  ASSERT_TRUE(flushed.mFlushedSequenceNumber.has_value());
+  EXPECT_EQ(*flushed.mFlushedSequenceNumber, 7u);
+
+  thread.Stop();
+}
+
+#ifdef RTLOG_ENABLE_INSTRUMENTATION
+TEST(InstrumentationTest, LogCostIsRecordedPerCallSite) {
+  rtlog::Logger<ExampleLogData, MAX_NUM_LOG_MESSAGES, MAX_LOG_MESSAGE_LENGTH,
+                gSequenceNumber>
+      logger;
+
+  for (int i = 0; i < 10; i++) {
+#ifdef RTLOG_USE_STB
+    logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+               "call site A %d", 7);
+#else
+    logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+               "call site A {}", 7);
+#endif // RTLOG_USE_STB
+  }
+
+  for (int i = 0; i < 3; i++) {
+#ifdef RTLOG_USE_STB
+    logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+               "call site B %f %f", 1.0, 2.0);
+#else
+    logger.Log({ExampleLogLevel::Debug, ExampleLogRegion::Engine},
+               "call site B {:f} {:f}", 1.0, 2.0);
+#endif // RTLOG_USE_STB
+  }
+
+  const auto stats = rtlog::GetCallSiteStats();
+  auto find = [&](const char *prefix) -> const rtlog::CallSiteStats * {
+    for (const auto &site : stats)
+      if (std::strncmp(site.mFormat, prefix, std::strlen(prefix)) == 0)
+        return &site;
+    return nullptr;
+  };
+
+  const auto *siteA = find("call site A");
+  const auto *siteB = find("call site B");
+  ASSERT_NE(siteA, nullptr);
+  ASSERT_NE(siteB, nullptr);
+
+  EXPECT_EQ(siteA->mNumCalls, 10u);
+  EXPECT_EQ(siteA->mTotalLength, 10u * std::strlen("call site A 7"));
+  EXPECT_EQ(siteA->mMaxLength, std::strlen("call site A 7"));
+  EXPECT_GE(siteA->mTotalTicks, siteA->mMaxTicks);
+
+  EXPECT_EQ(siteB->mNumCalls, 3u);
+  EXPECT_EQ(siteB->mMaxLength, std::strlen("call site B 1.000000 2.000000"));
+
+  EXPECT_EQ(rtlog::GetCallSiteStats(1).size(), 1u);
+  EXPECT_EQ(rtlog::GetNumUntrackedCalls(), 0u);
+}
+#endif // RTLOG_ENABLE_INSTRUMENTATION
+
+#ifdef RTLOG_HAS_PTHREADS
+TEST(LogProcessingThreadTest, ThreadOptionsAreAppliedAndReported) {
+  rtlog::SinkQueue<ExampleLogData, MAX_NUM_LOG_MESSAGES,
+                   MAX_LOG_MESSAGE_LENGTH>
+      queue;
+
+  rtlog::ThreadOptions options;
+  options.mName = "rtlog-processing-thread";
+  options.mSchedulingPolicy = SCHED_OTHER;
+#ifdef __linux__
+  // Whatever this process may run on and be niced to, rather than fixed values
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+  int cpu = 0;
+  while (!CPU_ISSET(cpu, &allowed))
+    cpu++;
+  options.mCpuAffinity = {cpu};
+
+  // Lowering the priority is always allowed
+  const auto niceValue = std::min(getpriority(PRIO_PROCESS, 0) + 1, 19);
+  options.mNiceValue = niceValue;
+#endif // __linux__
+
+  rtlog::LogProcessingThread thread(queue, PrintMessage,
+                                    std::chrono::milliseconds(10), options);
+
+  const auto stats = thread.GetStats();
+  EXPECT_TRUE(stats.mThreadOptionsApplied);
+  EXPECT_EQ(stats.mThreadSettings.mName, "rtlog-processin");
+  EXPECT_EQ(stats.mThreadSettings.mSchedulingPolicy, SCHED_OTHER);
+#ifdef __linux__
+  EXPECT_EQ(stats.mThreadSettings.mCpuAffinity, std::vector<int>{cpu});
+  EXPECT_EQ(stats.mThreadSettings.mNiceValue, niceValue);
+#endif // __linux__
+
+  thread.Stop();
+}
+#endif // RTLOG_HAS_PTHREADS
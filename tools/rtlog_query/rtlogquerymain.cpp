@@ -0,0 +1,139 @@
+#include <rtlog/indexed_file.h>
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+
+namespace {
+
+void PrintUsage() {
+  std::fprintf(
+      stderr,
+      "usage: rtlog_query <file> --seq <first> <last>\n"
+      "       rtlog_query <file> --time <first> <last>\n"
+      "       rtlog_query <file> --stats\n"
+      "       rtlog_query <file> --decompress <output>\n"
+      "\n"
+      "  --seq   print the records with a sequence number in [first, last]\n"
+      "  --time  print the records logged in [first, last], in seconds since\n"
+      "          the epoch (fractions allowed, e.g. 1700000000.25)\n"
+      "  --stats print the number of blocks and their ranges\n"
+      "  --decompress\n"
+      "          write a copy of the file with every block uncompressed\n");
+}
+
+bool ParseSeconds(const char *text, int64_t &nanoseconds) {
+  char *end = nullptr;
+  const auto seconds = std::strtod(text, &end);
+  if (end == text || *end != '\0' || !std::isfinite(seconds))
+    return false;
+  nanoseconds = static_cast<int64_t>(std::llround(seconds * 1e9));
+  return true;
+}
+
+bool ParseSequenceNumber(const char *text, uint64_t &sequenceNumber) {
+  char *end = nullptr;
+  sequenceNumber = std::strtoull(text, &end, 10);
+  return end != text && *end == '\0';
+}
+
+std::string FormatTimestamp(int64_t nanoseconds) {
+  auto seconds = static_cast<std::time_t>(nanoseconds / 1000000000);
+  auto fraction = nanoseconds % 1000000000;
+  if (fraction < 0) {
+    seconds--;
+    fraction += 1000000000;
+  }
+
+  std::tm utc{};
+#ifdef _WIN32
+  gmtime_s(&utc, &seconds);
+#else
+  gmtime_r(&seconds, &utc);
+#endif
+
+  char date[32]{};
+  std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &utc);
+
+  char result[48]{};
+  std::snprintf(result, sizeof(result), "%s.%09" PRId64 "Z", date,
+                static_cast<int64_t>(fraction));
+  return result;
+}
+
+void PrintRecord(const rtlog::IndexedFileReader::Record &record) {
+  std::printf("{%" PRIu64 "} %s %.*s\n", record.mSequenceNumber,
+              FormatTimestamp(record.mTimestamp).c_str(),
+              static_cast<int>(record.mMessage.size()), record.mMessage.data());
+}
+
+void PrintStats(const rtlog::IndexedFileReader &reader) {
+  const auto &blocks = reader.GetBlocks();
+  std::printf("blocks: %zu (%s)\n", blocks.size(),
+              reader.HasIndex() ? "indexed"
+                                : "no index, rebuilt from block headers");
+
+  for (const auto &block : blocks)
+    std::printf("  @%" PRIu64 " seq [%" PRIu64 ", %" PRIu64 "] time [%s, %s]\n",
+                block.mOffset, block.mMinSequenceNumber,
+                block.mMaxSequenceNumber,
+                FormatTimestamp(block.mMinTimestamp).c_str(),
+                FormatTimestamp(block.mMaxTimestamp).c_str());
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    PrintUsage();
+    return 1;
+  }
+
+  const rtlog::IndexedFileReader reader(argv[1]);
+  if (!reader.IsValid()) {
+    std::fprintf(stderr, "%s is not an indexed rtlog file\n", argv[1]);
+    return 1;
+  }
+
+  const std::string mode = argv[2];
+  size_t numDecoded = 0;
+
+  if (mode == "--stats" && argc == 3) {
+    PrintStats(reader);
+    return 0;
+  } else if (mode == "--decompress" && argc == 4) {
+    if (!reader.WriteDecompressed(argv[3])) {
+      std::fprintf(stderr, "could not write %s, or it is the input\n",
+                   argv[3]);
+      return 1;
+    }
+    return 0;
+  } else if (mode == "--seq" && argc == 5) {
+    uint64_t first = 0;
+    uint64_t last = 0;
+    if (!ParseSequenceNumber(argv[3], first) ||
+        !ParseSequenceNumber(argv[4], last)) {
+      PrintUsage();
+      return 1;
+    }
+    numDecoded = reader.ForEachInSequenceRange(first, last, PrintRecord);
+  } else if (mode == "--time" && argc == 5) {
+    int64_t first = 0;
+    int64_t last = 0;
+    if (!ParseSeconds(argv[3], first) || !ParseSeconds(argv[4], last)) {
+      PrintUsage();
+      return 1;
+    }
+    numDecoded = reader.ForEachInTimeRange(first, last, PrintRecord);
+  } else {
+    PrintUsage();
+    return 1;
+  }
+
+  std::fprintf(stderr, "decoded %zu of %zu blocks\n", numDecoded,
+               reader.GetBlocks().size());
+  return 0;
+}